@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include <functional>
+#include <cryptopp/osrng.h>
+#include <cryptopp/gzip.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "CPU.h"
+#include "aes.h"
+#include "ElGamal.h"
+#include "Signature.h"
+#include "hmac.h"
+#include "NTCPSession.h"
+#include "SSUData.h"
+#include "Streaming.h"
+
+// crypto microbenchmarks, run before rolling out new builds or on new hosts
+// usage: bench_crypto [duration per benchmark in milliseconds]
+
+static std::chrono::milliseconds benchDuration (1000);
+
+static uint64_t GetCycles ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc ();
+#else
+	return 0; // not available
+#endif
+}
+
+static void Bench (const char * name, std::function<void ()> op)
+{
+	op (); // warm up, lazy initializations
+	uint64_t num = 0, batch = 1;
+	auto start = std::chrono::steady_clock::now ();
+	uint64_t startCycles = GetCycles ();
+	std::chrono::steady_clock::duration elapsed;
+	do
+	{
+		auto batchStart = std::chrono::steady_clock::now ();
+		for (uint64_t i = 0; i < batch; i++)
+			op ();
+		num += batch;
+		auto now = std::chrono::steady_clock::now ();
+		if (now - batchStart < std::chrono::milliseconds (1))
+			batch *= 2; // don't call clock for fast operations too often
+		elapsed = now - start;
+	}
+	while (elapsed < benchDuration);
+	uint64_t cycles = GetCycles () - startCycles;
+	double seconds = std::chrono::duration<double>(elapsed).count ();
+	if (cycles)
+		printf ("%-36s %14.1f ops/sec %14.1f cycles/op\n", name, num/seconds, (double)cycles/num);
+	else
+		printf ("%-36s %14.1f ops/sec %14s cycles/op\n", name, num/seconds, "n/a");
+}
+
+static void BenchAES (CryptoPP::RandomNumberGenerator& rnd)
+{
+	uint8_t key[32], iv[16];
+	rnd.GenerateBlock (key, 32);
+	rnd.GenerateBlock (iv, 16);
+	i2p::crypto::AESAlignedBuffer<i2p::transport::NTCP_MAX_MESSAGE_SIZE> buf;
+	rnd.GenerateBlock (buf, i2p::transport::NTCP_MAX_MESSAGE_SIZE);
+
+	i2p::crypto::TunnelEncryption tunnelEncryption;
+	tunnelEncryption.SetKeys (key, key);
+	Bench ("TunnelEncryption 1024", [&]() { tunnelEncryption.Encrypt (buf); });
+	i2p::crypto::TunnelDecryption tunnelDecryption;
+	tunnelDecryption.SetKeys (key, key);
+	Bench ("TunnelDecryption 1024", [&]() { tunnelDecryption.Decrypt (buf); });
+
+	i2p::crypto::CBCEncryption encryption;
+	encryption.SetKey (key);
+	encryption.SetIV (iv);
+	i2p::crypto::CBCDecryption decryption;
+	decryption.SetKey (key);
+	decryption.SetIV (iv);
+	const size_t sizes[] =
+	{
+		i2p::transport::NTCP_BUFFER_SIZE,
+		i2p::transport::NTCP_MAX_MESSAGE_SIZE,
+		i2p::transport::SSU_V4_MAX_PACKET_SIZE & ~0x0F
+	};
+	for (auto len: sizes)
+	{
+		char name[64];
+		snprintf (name, sizeof (name), "CBCEncryption %d", (int)len);
+		Bench (name, [&]() { encryption.Encrypt (buf, len, buf); });
+		snprintf (name, sizeof (name), "CBCDecryption %d", (int)len);
+		Bench (name, [&]() { decryption.Decrypt (buf, len, buf); });
+	}
+}
+
+static void BenchElGamal (CryptoPP::RandomNumberGenerator& rnd)
+{
+	uint8_t priv[256], pub[256];
+	Bench ("DH keys pair", [&]() { i2p::crypto::GenerateElGamalKeyPair (rnd, priv, pub); });
+
+	// fixed-base tables against generic exponentiation, same 2048 bits exponent as DH keys pair
+	using i2p::crypto::GetCryptoConstants; // for elgg and elgp
+	CryptoPP::Integer x (priv, 256);
+	Bench ("ElggPow", [&]() { i2p::crypto::ElggPow (x); });
+	Bench ("a_exp_b_mod_c (elgg, x, elgp)", [&]() { a_exp_b_mod_c (elgg, x, elgp); });
+	if (i2p::crypto::ElggPow (x) != a_exp_b_mod_c (elgg, x, elgp))
+		printf ("ElggPow result mismatch\n");
+
+	uint8_t data[222], encrypted[514];
+	rnd.GenerateBlock (data, 222);
+	// pairs supplier is not started, every encryption generates its own k
+	i2p::crypto::ElGamalEncryption encryption (pub);
+	Bench ("ElGamalEncryption", [&]() { encryption.Encrypt (data, 222, encrypted, true); });
+	Bench ("ElGamalDecrypt", [&]() { i2p::crypto::ElGamalDecrypt (priv, encrypted, data, true); });
+}
+
+static void BenchSignature (CryptoPP::RandomNumberGenerator& rnd, const char * name,
+	i2p::crypto::Signer * signer, i2p::crypto::Verifier * verifier)
+{
+	uint8_t buf[1024], signature[1024];
+	rnd.GenerateBlock (buf, 1024);
+	char s[64];
+	snprintf (s, sizeof (s), "%s sign", name);
+	Bench (s, [&]() { signer->Sign (rnd, buf, 1024, signature); });
+	snprintf (s, sizeof (s), "%s verify", name);
+	Bench (s, [&]() { verifier->Verify (buf, 1024, signature); });
+	if (!verifier->Verify (buf, 1024, signature))
+		printf ("%s signature verification failed\n", name);
+	verifier->Precompute ();
+	if (verifier->IsPrecomputed ())
+	{
+		snprintf (s, sizeof (s), "%s verify precomputed", name);
+		Bench (s, [&]() { verifier->Verify (buf, 1024, signature); });
+	}
+	delete signer;
+	delete verifier;
+}
+
+static void BenchSignatures (CryptoPP::RandomNumberGenerator& rnd)
+{
+	uint8_t priv[1024], pub[512];
+	i2p::crypto::CreateDSARandomKeys (rnd, priv, pub);
+	BenchSignature (rnd, "DSA-SHA1", new i2p::crypto::DSASigner (priv), new i2p::crypto::DSAVerifier (pub));
+	i2p::crypto::CreateECDSAP256RandomKeys (rnd, priv, pub);
+	BenchSignature (rnd, "ECDSA-SHA256-P256", new i2p::crypto::ECDSAP256Signer (priv), new i2p::crypto::ECDSAP256Verifier (pub));
+	i2p::crypto::CreateECDSAP384RandomKeys (rnd, priv, pub);
+	BenchSignature (rnd, "ECDSA-SHA384-P384", new i2p::crypto::ECDSAP384Signer (priv), new i2p::crypto::ECDSAP384Verifier (pub));
+	i2p::crypto::CreateECDSAP521RandomKeys (rnd, priv, pub);
+	BenchSignature (rnd, "ECDSA-SHA512-P521", new i2p::crypto::ECDSAP521Signer (priv), new i2p::crypto::ECDSAP521Verifier (pub));
+	i2p::crypto::CreateRSARandomKeys (rnd, i2p::crypto::RSASHA2562048_KEY_LENGTH, priv, pub);
+	BenchSignature (rnd, "RSA-SHA256-2048", new i2p::crypto::RSASHA2562048Signer (priv), new i2p::crypto::RSASHA2562048Verifier (pub));
+	i2p::crypto::CreateRSARandomKeys (rnd, i2p::crypto::RSASHA3843072_KEY_LENGTH, priv, pub);
+	BenchSignature (rnd, "RSA-SHA384-3072", new i2p::crypto::RSASHA3843072Signer (priv), new i2p::crypto::RSASHA3843072Verifier (pub));
+	i2p::crypto::CreateRSARandomKeys (rnd, i2p::crypto::RSASHA5124096_KEY_LENGTH, priv, pub);
+	BenchSignature (rnd, "RSA-SHA512-4096", new i2p::crypto::RSASHA5124096Signer (priv), new i2p::crypto::RSASHA5124096Verifier (pub));
+}
+
+static void BenchHMAC (CryptoPP::RandomNumberGenerator& rnd)
+{
+	i2p::crypto::MACKey key;
+	rnd.GenerateBlock (key, 32);
+	uint8_t buf[i2p::transport::SSU_V4_MAX_PACKET_SIZE], digest[16];
+	rnd.GenerateBlock (buf, sizeof (buf));
+	char name[64];
+	snprintf (name, sizeof (name), "HMACMD5Digest %d", (int)sizeof (buf));
+	Bench (name, [&]() { i2p::crypto::HMACMD5Digest (buf, sizeof (buf), key, digest); });
+}
+
+static void BenchGzip (CryptoPP::RandomNumberGenerator& rnd)
+{
+	// half random, half text-like to be somewhat compressible
+	uint8_t buf[i2p::stream::STREAMING_MTU], compressed[i2p::stream::MAX_PACKET_SIZE];
+	rnd.GenerateBlock (buf, sizeof (buf));
+	for (size_t i = sizeof (buf)/2; i < sizeof (buf); i++)
+		buf[i] = 'a' + buf[i] % 16;
+	const size_t sizes[] = { i2p::stream::COMPRESSION_THRESHOLD_SIZE, i2p::stream::STREAMING_MTU };
+	for (auto len: sizes)
+	{
+		// same deflate level as Stream::CreateDataMessage
+		int level = len <= i2p::stream::COMPRESSION_THRESHOLD_SIZE ?
+			CryptoPP::Gzip::MIN_DEFLATE_LEVEL : CryptoPP::Gzip::DEFAULT_DEFLATE_LEVEL;
+		size_t compressedLen = 0;
+		char name[64];
+		snprintf (name, sizeof (name), "Gzip %d", (int)len);
+		Bench (name, [&]()
+			{
+				CryptoPP::Gzip compressor;
+				compressor.SetDeflateLevel (level);
+				compressor.Put (buf, len);
+				compressor.MessageEnd();
+				compressedLen = compressor.MaxRetrievable ();
+				compressor.Get (compressed, compressedLen);
+			});
+		snprintf (name, sizeof (name), "Gunzip %d", (int)len);
+		Bench (name, [&]()
+			{
+				CryptoPP::Gunzip decompressor;
+				decompressor.Put (compressed, compressedLen);
+				decompressor.MessageEnd();
+				decompressor.Get (buf, decompressor.MaxRetrievable ());
+			});
+	}
+}
+
+int main (int argc, char* argv[])
+{
+	if (argc > 1)
+		benchDuration = std::chrono::milliseconds (atoi (argv[1]));
+	i2p::cpu::Detect ();
+	printf ("Crypto implementations: %s\n", i2p::cpu::GetCryptoImplementations ().c_str ());
+	CryptoPP::AutoSeededRandomPool rnd;
+	BenchAES (rnd);
+	BenchElGamal (rnd);
+	BenchSignatures (rnd);
+	BenchHMAC (rnd);
+	BenchGzip (rnd);
+	return EXIT_SUCCESS;
+}
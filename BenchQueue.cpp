@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include "Queue.h"
+
+// compares i2p::util::Queue consumed element by element, Queue with GetAll and MPSCQueue
+// usage: bench_queue [messages per producer]
+
+struct BenchMsg
+{
+	int producer, seq;
+	BenchMsg * next; // for MPSCQueue
+};
+
+static int numMsgs = 1000000;
+
+template<class TQueue>
+static void Bench (const char * name, int numProducers, bool putMany,
+	std::function<void (TQueue& queue, std::vector<BenchMsg *>& msgs)> get)
+{
+	TQueue queue;
+	std::vector<BenchMsg> buf (numProducers*numMsgs);
+	auto start = std::chrono::steady_clock::now ();
+	std::vector<std::thread *> producers;
+	for (int i = 0; i < numProducers; i++)
+		producers.push_back (new std::thread ([&queue, &buf, i, putMany]()
+			{
+				BenchMsg * msgs = buf.data () + i*numMsgs;
+				std::vector<BenchMsg *> batch;
+				for (int j = 0; j < numMsgs; j++)
+				{
+					msgs[j].producer = i;
+					msgs[j].seq = j;
+					if (putMany)
+					{
+						batch.push_back (msgs + j);
+						if (batch.size () >= 16)
+						{
+							queue.PutMany (batch);
+							batch.clear ();
+						}
+					}
+					else
+						queue.Put (msgs + j);
+				}
+				queue.PutMany (batch);
+			}));
+	// consumer, checks FIFO order per producer
+	std::vector<int> next (numProducers, 0);
+	std::vector<BenchMsg *> msgs;
+	int total = numProducers*numMsgs, received = 0, errors = 0;
+	while (received < total)
+	{
+		msgs.clear ();
+		get (queue, msgs);
+		for (auto it: msgs)
+		{
+			if (it->seq != next[it->producer]) errors++;
+			next[it->producer] = it->seq + 1;
+		}
+		received += msgs.size ();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now () - start).count ();
+	for (auto it: producers)
+	{
+		it->join ();
+		delete it;
+	}
+	printf ("%-36s %2d producers %12.0f msgs/sec%s\n", name, numProducers, total/seconds, errors ? " ORDER ERRORS" : "");
+}
+
+int main (int argc, char* argv[])
+{
+	if (argc > 1)
+		numMsgs = atoi (argv[1]);
+	typedef i2p::util::Queue<BenchMsg> Queue;
+	typedef i2p::util::MPSCQueue<BenchMsg> MPSCQueue;
+	const int numProducers[] = { 1, 2, 4, 8 };
+	for (auto n: numProducers)
+	{
+		// as consumers did before, GetNextWithTimeout and Get until empty
+		Bench<Queue> ("Queue Put/Get", n, false, [](Queue& queue, std::vector<BenchMsg *>& msgs)
+			{
+				BenchMsg * msg = queue.GetNextWithTimeout (100);
+				while (msg)
+				{
+					msgs.push_back (msg);
+					msg = queue.Get ();
+				}
+			});
+		Bench<Queue> ("Queue Put/GetAll", n, false, [](Queue& queue, std::vector<BenchMsg *>& msgs)
+			{
+				BenchMsg * msg = queue.GetNextWithTimeout (100);
+				if (msg)
+				{
+					msgs.push_back (msg);
+					queue.GetAll (msgs);
+				}
+			});
+		Bench<MPSCQueue> ("MPSCQueue Put/GetAllWithTimeout", n, false, [](MPSCQueue& queue, std::vector<BenchMsg *>& msgs)
+			{
+				queue.GetAllWithTimeout (msgs, 100);
+			});
+		Bench<MPSCQueue> ("MPSCQueue PutMany/GetAllWithTimeout", n, true, [](MPSCQueue& queue, std::vector<BenchMsg *>& msgs)
+			{
+				queue.GetAllWithTimeout (msgs, 100);
+			});
+	}
+	return EXIT_SUCCESS;
+}
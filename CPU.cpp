@@ -0,0 +1,53 @@
+#include <inttypes.h>
+#if defined(AESNI)
+#include <cpuid.h>
+#endif
+#include "CPU.h"
+
+namespace i2p
+{
+namespace cpu
+{
+	bool aesni = false;
+	bool vaes = false;
+	bool shani = false;
+
+#if defined(AESNI)
+	static bool IsYMMEnabled () // by OS
+	{
+		unsigned int eax, ebx, ecx, edx;
+		if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx)) return false;
+		const unsigned int OSXSAVE = 1 << 27, AVX = 1 << 28;
+		if ((ecx & (OSXSAVE | AVX)) != (OSXSAVE | AVX)) return false;
+		uint32_t xcr0, xcr0h;
+		__asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0h) : "c"(0)); 
+		return (xcr0 & 0x06) == 0x06; // XMM and YMM state
+	}
+#endif
+
+	void Detect ()
+	{
+#if defined(AESNI)
+		unsigned int eax, ebx, ecx, edx;
+		if (__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+			aesni = ecx & (1 << 25);
+		if (__get_cpuid_max (0, nullptr) >= 7)
+		{
+			__cpuid_count (7, 0, eax, ebx, ecx, edx);
+			bool avx2 = ebx & (1 << 5);
+			vaes = aesni && avx2 && (ecx & (1 << 9)) && IsYMMEnabled ();
+			shani = ebx & (1 << 29);
+		}
+#endif
+	}
+
+	std::string GetCryptoImplementations ()
+	{
+		std::string s ("AES: ");
+		s += vaes ? "VAES" : (aesni ? "AES-NI" : "crypto++");
+		s += ", SHA-256: ";
+		s += shani ? "SHA-NI" : "crypto++";
+		return s;
+	}
+}
+}
@@ -0,0 +1,20 @@
+#ifndef CPU_H__
+#define CPU_H__
+
+#include <string>
+
+namespace i2p
+{
+namespace cpu
+{
+	// set by Detect, stay false if kernels are not built (no AESNI) 
+	extern bool aesni;
+	extern bool vaes; // 2 AES blocks per instruction, requires AVX2
+	extern bool shani;
+
+	void Detect ();
+	std::string GetCryptoImplementations (); // for log and web interface
+}
+}
+
+#endif
@@ -28,6 +28,7 @@ namespace client
 	
 	void ClientContext::Start ()
 	{
+		SetLocalLoopback (i2p::util::config::GetArg("-loopback", 1));
 		if (!m_SharedLocalDestination)
 		{	
 			m_SharedLocalDestination = CreateNewLocalDestination (); // non-public, DSA
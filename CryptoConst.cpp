@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <cryptopp/modarith.h>
 #include "CryptoConst.h"
 
 namespace i2p
@@ -67,7 +68,56 @@ namespace crypto
 		};	
 		return cryptoConstants;
 	}	
-	
+
+	const int ELGG_TABLE_WINDOW_BITS = 4; // 2 MB of tables for 2048 bits
+	const int ELGG_TABLE_NUM_WINDOWS = 2048/ELGG_TABLE_WINDOW_BITS;
+	const int ELGG_TABLE_WINDOW_SIZE = (1 << ELGG_TABLE_WINDOW_BITS) - 1; // zero digit is not stored
+
+	class ElggTable
+	{
+		public:
+
+			ElggTable (): m_Montgomery (elgp)
+			{
+				// row i contains elgg^(d*16^i) for d = 1..15 in Montgomery form
+				CryptoPP::Integer base = m_Montgomery.ConvertIn (elgg); 
+				for (int i = 0; i < ELGG_TABLE_NUM_WINDOWS; i++)
+				{
+					auto row = m_Table[i];
+					row[0] = base;
+					for (int j = 1; j < ELGG_TABLE_WINDOW_SIZE; j++)
+						row[j] = m_Montgomery.Multiply (row[j - 1], base);
+					base = m_Montgomery.Multiply (row[ELGG_TABLE_WINDOW_SIZE - 1], base); 
+				}	
+			}
+
+			CryptoPP::Integer Pow (const CryptoPP::Integer& x) const
+			{
+				int numWindows = (x.BitCount () + ELGG_TABLE_WINDOW_BITS - 1)/ELGG_TABLE_WINDOW_BITS;
+				if (x.IsNegative () || numWindows > ELGG_TABLE_NUM_WINDOWS)
+					return a_exp_b_mod_c (elgg, x, elgp);
+				// one multiplication per non-zero digit, no squarings
+				CryptoPP::MontgomeryRepresentation mr (m_Montgomery); // results are kept inside, copy per call
+				CryptoPP::Integer r = mr.MultiplicativeIdentity ();
+				for (int i = 0; i < numWindows; i++)
+				{
+					auto d = x.GetBits (i*ELGG_TABLE_WINDOW_BITS, ELGG_TABLE_WINDOW_BITS);
+					if (d) r = mr.Multiply (r, m_Table[i][d - 1]);
+				}	
+				return mr.ConvertOut (r);
+			}	
+
+		private:
+
+			CryptoPP::MontgomeryRepresentation m_Montgomery;
+			CryptoPP::Integer m_Table[ELGG_TABLE_NUM_WINDOWS][ELGG_TABLE_WINDOW_SIZE];
+	};	
+
+	CryptoPP::Integer ElggPow (const CryptoPP::Integer& x)
+	{
+		static ElggTable table; // built by first caller, DH keys supplier at startup
+		return table.Pow (x);
+	}	
 }
 }
 
@@ -32,6 +32,9 @@ namespace crypto
 
 	// RSA
 	const int rsae = 65537;	
+
+	// elgg^x mod elgp by precomputed fixed-base tables, about 3 times faster than a_exp_b_mod_c
+	CryptoPP::Integer ElggPow (const CryptoPP::Integer& x);
 }		
 }	
 
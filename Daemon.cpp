@@ -5,6 +5,7 @@
 #include "Log.h"
 #include "base64.h"
 #include "version.h"
+#include "CPU.h"
 #include "Transports.h"
 #include "NTCPSession.h"
 #include "RouterInfo.h"
@@ -52,10 +53,12 @@ namespace i2p
 		bool Daemon_Singleton::init(int argc, char* argv[])
 		{
 			i2p::util::config::OptionParser(argc, argv);
+			i2p::cpu::Detect ();
 			i2p::context.Init ();
 
 			LogPrint("\n\n\n\ni2pd starting\n");
 			LogPrint("Version ", VERSION);
+			LogPrint("Crypto: ", i2p::cpu::GetCryptoImplementations ());
 			LogPrint("data directory: ", i2p::util::filesystem::GetDataDir().string());
 			i2p::util::filesystem::ReadConfigFile(i2p::util::config::mapArgs, i2p::util::config::mapMultiArgs);
 
@@ -46,6 +46,11 @@ namespace datagram
 
 	void DatagramDestination::SendMsg (I2NPMessage * msg, const i2p::data::LeaseSet& remote)
 	{
+		if (m_Owner.IsLocalLoopback (remote.GetIdentHash ()))
+		{
+			m_Owner.SendLocalDataMessage (remote.GetIdentHash (), msg);
+			return;
+		}	
 		auto outboundTunnel = m_Owner.GetTunnelPool ()->GetNextOutboundTunnel ();
 		auto leases = remote.GetNonExpiredLeases ();
 		if (!leases.empty () && outboundTunnel)
@@ -1,6 +1,5 @@
 #include <algorithm>
 #include <boost/lexical_cast.hpp>
-#include <cryptopp/dh.h>
 #include "Log.h"
 #include "util.h"
 #include "NetDb.h"
@@ -10,16 +9,27 @@ namespace i2p
 {
 namespace client
 {
+	static std::mutex loopbackDestinationsMutex;
+	static std::map<i2p::data::IdentHash, ClientDestination *> loopbackDestinations; // running
+	static bool isLoopbackEnabled = true;
+
+	void SetLocalLoopback (bool enabled)
+	{
+		isLoopbackEnabled = enabled;
+		LogPrint (eLogInfo, "Local loopback ", enabled ? "enabled" : "disabled");
+	}	
+
 	ClientDestination::ClientDestination (const i2p::data::PrivateKeys& keys, bool isPublic, 
 			const std::map<std::string, std::string> * params):
 		m_IsRunning (false), m_Thread (nullptr), m_Service (nullptr), m_Work (nullptr),	
 		m_Keys (keys), m_LeaseSet (nullptr), m_IsPublic (isPublic), m_PublishReplyToken (0),
 		m_DatagramDestination (nullptr), m_PublishConfirmationTimer (nullptr)
 	{
-		CryptoPP::DH dh (i2p::crypto::elgp, i2p::crypto::elgg);
-		dh.GenerateKeyPair(i2p::context.GetRandomNumberGenerator (), m_EncryptionPrivateKey, m_EncryptionPublicKey);
+		i2p::crypto::GenerateElGamalKeyPair (i2p::context.GetRandomNumberGenerator (), m_EncryptionPrivateKey, m_EncryptionPublicKey);
 		int inboundTunnelLen = DEFAULT_INBOUND_TUNNEL_LENGTH;
 		int outboundTunnelLen = DEFAULT_OUTBOUND_TUNNEL_LENGTH;
+		int numInboundSpareTunnels = i2p::tunnel::DEFAULT_NUM_SPARE_TUNNELS;
+		int numOutboundSpareTunnels = i2p::tunnel::DEFAULT_NUM_SPARE_TUNNELS;
 		if (params)
 		{
 			auto it = params->find (I2CP_PARAM_INBOUND_TUNNEL_LENGTH);
@@ -42,8 +52,29 @@ namespace client
 					LogPrint (eLogInfo, "Outbound tunnel length set to ", len);
 				}
 			}	
+			it = params->find (I2CP_PARAM_INBOUND_TUNNELS_BACKUP_QUANTITY);
+			if (it != params->end ())
+			{
+				int num = boost::lexical_cast<int>(it->second);
+				if (num >= 0)
+				{
+					numInboundSpareTunnels = num;
+					LogPrint (eLogInfo, "Inbound spare tunnels set to ", num);
+				}
+			}	
+			it = params->find (I2CP_PARAM_OUTBOUND_TUNNELS_BACKUP_QUANTITY);
+			if (it != params->end ())
+			{
+				int num = boost::lexical_cast<int>(it->second);
+				if (num >= 0)
+				{
+					numOutboundSpareTunnels = num;
+					LogPrint (eLogInfo, "Outbound spare tunnels set to ", num);
+				}
+			}	
 		}	
 		m_Pool = i2p::tunnel::tunnels.CreateTunnelPool (*this, inboundTunnelLen, outboundTunnelLen);  
+		m_Pool->SetNumSpareTunnels (numInboundSpareTunnels, numOutboundSpareTunnels);
 		if (m_IsPublic)
 			LogPrint (eLogInfo, "Local address ", GetIdentHash ().ToBase32 (), ".b32.i2p created");
 		m_StreamingDestination = new i2p::stream::StreamingDestination (*this); // TODO:
@@ -89,10 +120,21 @@ namespace client
 		m_IsRunning = true;
 		m_Thread = new std::thread (std::bind (&ClientDestination::Run, this));
 		m_StreamingDestination->Start ();	
+		std::unique_lock<std::mutex> l(loopbackDestinationsMutex);
+		loopbackDestinations[GetIdentHash ()] = this;
 	}
 		
 	void ClientDestination::Stop ()
 	{	
+		{
+			// nothing is posted to us after that
+			std::unique_lock<std::mutex> l(loopbackDestinationsMutex);
+			loopbackDestinations.erase (GetIdentHash ());
+			// our LeaseSets are lost, send them again if we get restarted
+			for (auto it: loopbackDestinations)
+				it.second->m_LoopbackLeaseSetSent.erase (GetIdentHash ());
+			m_LoopbackLeaseSetSent.clear ();
+		}	
 		m_StreamingDestination->Stop ();	
 		if (m_DatagramDestination)
 		{
@@ -269,6 +311,10 @@ namespace client
 	{
 		i2p::garlic::GarlicDestination::SetLeaseSetUpdated ();	
 		UpdateLeaseSet ();
+		{
+			std::unique_lock<std::mutex> l(loopbackDestinationsMutex);
+			m_LoopbackLeaseSetSent.clear ();
+		}	
 		if (m_IsPublic)
 			Publish ();
 	}
@@ -388,5 +434,45 @@ namespace client
 			m_DatagramDestination = new i2p::datagram::DatagramDestination (*this);
 		return m_DatagramDestination;	
 	}
+
+	bool ClientDestination::IsLocalLoopback (const i2p::data::IdentHash& remote) const
+	{
+		if (!isLoopbackEnabled) return false;
+		std::unique_lock<std::mutex> l(loopbackDestinationsMutex);
+		return loopbackDestinations.count (remote) > 0;
+	}	
+
+	void ClientDestination::SendLocalDataMessage (const i2p::data::IdentHash& remote, I2NPMessage * msg)
+	{
+		std::unique_lock<std::mutex> l(loopbackDestinationsMutex);
+		auto it = loopbackDestinations.find (remote);
+		if (it != loopbackDestinations.end () && it->second->m_Service)
+		{
+			auto dest = it->second;
+			if (!m_LoopbackLeaseSetSent.count (remote))
+			{
+				// remote needs our LeaseSet to reply, garlic would have bundled it
+				auto leaseSet = GetLeaseSet ();
+				if (leaseSet)
+				{
+					dest->m_Service->post (std::bind (&ClientDestination::HandleLocalMessage, dest, 
+						i2p::CreateDatabaseStoreMsg (leaseSet)));
+					m_LoopbackLeaseSetSent.insert (remote);
+				}	
+			}	
+			dest->m_Service->post (std::bind (&ClientDestination::HandleLocalMessage, dest, msg));
+		}
+		else
+		{
+			LogPrint (eLogWarning, "Local destination ", remote.ToBase32 (), ".b32.i2p is not running");
+			i2p::DeleteI2NPMessage (msg);
+		}	
+	}	
+
+	void ClientDestination::HandleLocalMessage (I2NPMessage * msg)
+	{
+		HandleI2NPMessage (msg->GetBuffer (), msg->GetLength (), nullptr);
+		i2p::DeleteI2NPMessage (msg);
+	}	
 }
 }
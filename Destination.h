@@ -28,6 +28,10 @@ namespace client
 	const int DEFAULT_INBOUND_TUNNEL_LENGTH = 3;
 	const char I2CP_PARAM_OUTBOUND_TUNNEL_LENGTH[] = "outbound.length";
 	const int DEFAULT_OUTBOUND_TUNNEL_LENGTH = 3;
+	const char I2CP_PARAM_INBOUND_TUNNELS_BACKUP_QUANTITY[] = "inbound.backupQuantity";
+	const char I2CP_PARAM_OUTBOUND_TUNNELS_BACKUP_QUANTITY[] = "outbound.backupQuantity";
+
+	void SetLocalLoopback (bool enabled); // deliver between destinations of this router directly, on by default
 	
 	class ClientDestination: public i2p::garlic::GarlicDestination
 	{
@@ -55,6 +59,10 @@ namespace client
 			i2p::datagram::DatagramDestination * GetDatagramDestination () const { return m_DatagramDestination; };
 			i2p::datagram::DatagramDestination * CreateDatagramDestination ();
 
+			// local loopback, bypasses tunnels and garlic if remote destination runs on this router 
+			bool IsLocalLoopback (const i2p::data::IdentHash& remote) const;
+			void SendLocalDataMessage (const i2p::data::IdentHash& remote, I2NPMessage * msg);
+
 			// implements LocalDestination
 			const i2p::data::PrivateKeys& GetPrivateKeys () const { return m_Keys; };
 			const uint8_t * GetEncryptionPrivateKey () const { return m_EncryptionPrivateKey; };
@@ -81,6 +89,7 @@ namespace client
 			void HandlePublishConfirmationTimer (const boost::system::error_code& ecode);
 			void HandleDatabaseStoreMessage (const uint8_t * buf, size_t len);	
 			void HandleDeliveryStatusMessage (I2NPMessage * msg);		
+			void HandleLocalMessage (I2NPMessage * msg);
 
 		private:
 
@@ -102,6 +111,7 @@ namespace client
 			i2p::datagram::DatagramDestination * m_DatagramDestination;
 	
 			boost::asio::deadline_timer * m_PublishConfirmationTimer;
+			std::set<i2p::data::IdentHash> m_LoopbackLeaseSetSent; // local destinations have our current LeaseSet
 
 		public:
 			
@@ -0,0 +1,81 @@
+#include "ElGamal.h"
+
+namespace i2p
+{
+namespace crypto
+{
+	ElGamalPairsSupplier elGamalPairsSupplier (32); // 32 pre-generated pairs 
+
+	ElGamalPairsSupplier::ElGamalPairsSupplier (int size):
+		m_QueueSize (size), m_IsRunning (false), m_Thread (nullptr)
+	{
+	}	
+
+	ElGamalPairsSupplier::~ElGamalPairsSupplier ()
+	{
+		Stop ();
+	}
+
+	void ElGamalPairsSupplier::Start ()
+	{
+		m_IsRunning = true;
+		m_Thread = new std::thread (std::bind (&ElGamalPairsSupplier::Run, this));
+	}
+
+	void ElGamalPairsSupplier::Stop ()
+	{
+		{
+			std::unique_lock<std::mutex>  l(m_AcquiredMutex);
+			m_IsRunning = false;
+			m_Acquired.notify_one ();	
+		}
+		if (m_Thread)
+		{	
+			m_Thread->join (); 
+			delete m_Thread;
+			m_Thread = 0;
+		}	
+	}
+
+	void ElGamalPairsSupplier::Run ()
+	{
+		std::unique_lock<std::mutex>  l(m_AcquiredMutex);
+		while (m_IsRunning)
+		{
+			if ((int)m_Queue.size () < m_QueueSize)
+			{
+				l.unlock ();
+				ElGamalPair pair;
+				CreateElGamalPair (m_Rnd, pair); // outside of lock
+				l.lock ();
+				m_Queue.push (pair);
+			}
+			else
+				m_Acquired.wait (l); // wait for element gets aquired
+		}
+	}		
+
+	void ElGamalPairsSupplier::CreateElGamalPair (CryptoPP::RandomNumberGenerator& rnd, ElGamalPair& pair) const
+	{
+		pair.k = CryptoPP::Integer (rnd, CryptoPP::Integer::One(), elgp-1);
+		pair.a = ElggPow (pair.k);
+	}
+
+	void ElGamalPairsSupplier::Acquire (ElGamalPair& pair)
+	{
+		{
+			std::unique_lock<std::mutex>  l(m_AcquiredMutex);
+			if (!m_Queue.empty ())
+			{
+				pair = m_Queue.front ();
+				m_Queue.pop ();
+				m_Acquired.notify_one ();
+				return;
+			}	
+		}
+		// queue is empty, create new
+		CryptoPP::AutoSeededRandomPool rnd; // m_Rnd belongs to supplier's thread
+		CreateElGamalPair (rnd, pair);
+	}
+}
+}
@@ -2,9 +2,15 @@
 #define EL_GAMAL_H__
 
 #include <inttypes.h>
+#include <string.h>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <cryptopp/integer.h>
 #include <cryptopp/osrng.h>
 #include <cryptopp/sha.h>
+#include <cryptopp/dh.h>
 #include "CryptoConst.h"
 #include "Log.h"
 
@@ -13,24 +19,58 @@ namespace i2p
 namespace crypto
 {
 
+	struct ElGamalPair // ephemeral k and a = g^k, doesn't depend on recipient
+	{
+		CryptoPP::Integer k, a;
+	};
+
+	class ElGamalPairsSupplier
+	{
+		public:
+
+			ElGamalPairsSupplier (int size);
+			~ElGamalPairsSupplier ();
+			void Start ();
+			void Stop ();
+			void Acquire (ElGamalPair& pair); // thread safe, computes g^k in place if queue is empty
+
+		private:
+
+			void Run ();
+			void CreateElGamalPair (CryptoPP::RandomNumberGenerator& rnd, ElGamalPair& pair) const;
+
+		private:
+
+			const int m_QueueSize;
+			std::queue<ElGamalPair> m_Queue;
+
+			bool m_IsRunning;
+			std::thread * m_Thread;	
+			std::condition_variable m_Acquired;
+			std::mutex m_AcquiredMutex;
+			CryptoPP::AutoSeededRandomPool m_Rnd;
+	};
+
+	extern ElGamalPairsSupplier elGamalPairsSupplier;
+
 	class ElGamalEncryption
 	{
 		public:
 
-			ElGamalEncryption (const uint8_t * key):
-				y (key, 256), k (rnd, CryptoPP::Integer::One(), elgp-1),
-				a (a_exp_b_mod_c (elgg, k, elgp)), b1 (a_exp_b_mod_c (y, k, elgp))
-			{
-			}
+			ElGamalEncryption (const uint8_t * key): y (key, 256) {};
 
 			void Encrypt (const uint8_t * data, int len, uint8_t * encrypted, bool zeroPadding = false)
 			{
+				// fresh k for every message, b1 = y^k is the only exponentiation left 
+				ElGamalPair pair;
+				elGamalPairsSupplier.Acquire (pair);
+				const CryptoPP::Integer& a = pair.a;
 				// calculate b = b1*m mod p
 				uint8_t m[255];
 				m[0] = 0xFF;
 				memcpy (m+33, data, len);
 				CryptoPP::SHA256().CalculateDigest(m+1, m+33, 222);
-				CryptoPP::Integer b (a_times_b_mod_c (b1, CryptoPP::Integer (m, 255), elgp));
+				CryptoPP::Integer b (a_times_b_mod_c (a_exp_b_mod_c (y, pair.k, elgp), CryptoPP::Integer (m, 255), elgp));
 
 				// copy a and b
 				if (zeroPadding)
@@ -49,11 +89,17 @@ namespace crypto
 
 		private:
 
-			CryptoPP::AutoSeededRandomPool rnd;	
-			CryptoPP::Integer y, k, a, b1;	
-			bool m_ZeroPadding;	
+			CryptoPP::Integer y;	
 	};
 
+	inline void GenerateElGamalKeyPair (CryptoPP::RandomNumberGenerator& rnd, uint8_t * priv, uint8_t * pub)
+	{
+		// private key is chosen by crypto++ DH, public is calculated from precomputed tables 
+		CryptoPP::DH dh (elgp, elgg);
+		dh.GeneratePrivateKey (rnd, priv);
+		ElggPow (CryptoPP::Integer (priv, 256)).Encode (pub, 256);
+	}	
+
 	inline bool ElGamalDecrypt (const uint8_t * key, const uint8_t * encrypted, 
 		uint8_t * data, bool zeroPadding = false)
 	{
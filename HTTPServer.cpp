@@ -6,12 +6,14 @@
 #include "TransitTunnel.h"
 #include "Transports.h"
 #include "NetDb.h"
+#include "Profiling.h"
 #include "I2PEndian.h"
 #include "Streaming.h"
 #include "Destination.h"
 #include "RouterContext.h"
 #include "ClientContext.h"
 #include "HTTPServer.h"
+#include "CPU.h"
 
 // For image and info
 #include "version.h"
@@ -642,6 +644,7 @@ namespace util
 	void HTTPConnection::FillContent (std::stringstream& s)
 	{
 		s << "<h2>Welcome to the Webconsole!</h2><br><br>";
+		s << "<b>Crypto:</b> " << i2p::cpu::GetCryptoImplementations () << "<br>";
 		s << "<b>Data path:</b> " << i2p::util::filesystem::GetDataDir().string() << "<br>" << "<br>";
 		s << "<b>Our external address:</b>" << "<br>";
 		for (auto& address : i2p::context.GetRouterInfo().GetAddresses())
@@ -667,7 +670,53 @@ namespace util
 		}
 		s << "<br><b>Routers:</b> <i>" << i2p::data::netdb.GetNumRouters () << "</i> ";
 		s << "<b>Floodfills:</b> <i>" << i2p::data::netdb.GetNumFloodfills () << "</i> ";
-		s << "<b>LeaseSets:</b> <i>" << i2p::data::netdb.GetNumLeaseSets () << "</i><br>";
+		s << "<b>LeaseSets:</b> <i>" << i2p::data::netdb.GetNumLeaseSets () << "</i> ";
+		s << "<b>Pending verifications:</b> <i>" << i2p::data::netdb.GetNumPendingVerifications () << "</i><br>";
+		auto verifiersCacheStats = i2p::data::GetVerifiersCacheStats ();
+		s << "<b>Verifiers cache:</b> <i>" << verifiersCacheStats.size << "</i> keys, " << verifiersCacheStats.numPrecomputed << " precomputed, ";
+		auto numLookups = verifiersCacheStats.hits + verifiersCacheStats.misses;
+		s << "hit ratio " << (numLookups ? verifiersCacheStats.hits*100/numLookups : 0) << "%, ";
+		s << "~" << verifiersCacheStats.memoryUsage/1024 << " KB<br>";
+
+		s << "<br><b>I2NP buffers:</b><br>";
+		for (auto& it: i2p::GetI2NPMessagesPoolStats ())
+		{
+			s << it.bufferSize << ": <i>" << it.inUse << "</i> in use (max " << it.highWaterMark << "), ";
+			s << it.hits << " hits, " << it.misses << " misses, " << it.numShared << " free<br>";
+		}	
+		auto buildStats = i2p::GetTunnelBuildWorkersStats ();
+		s << "<br><b>Tunnel build requests:</b> <i>" << buildStats.queued << "</i> queued, ";
+		s << buildStats.processed << " processed, " << buildStats.rejected << " rejected, " << buildStats.dropped << " dropped, ";
+		s << buildStats.expired << " expired<br>";
+		s << "ElGamal decryption: " << buildStats.avgDecryptTime << " us average, " << buildStats.maxDecryptTime << " us max<br>";
+		auto gatewayStats = i2p::tunnel::GetTunnelGatewayStats ();
+		s << "<b>Tunnel gateways:</b> <i>" << gatewayStats.numTunnelDataMsgs << "</i> tunnel messages, fill ratio ";
+		if (gatewayStats.numTunnelDataMsgs)
+		{	
+			s << gatewayStats.numPayloadBytes*100/(gatewayStats.numTunnelDataMsgs*i2p::tunnel::TUNNEL_DATA_MAX_PAYLOAD_SIZE) << "% ";
+			if (gatewayStats.numUncoalescedMsgs)
+				s << "(" << gatewayStats.numPayloadBytes*100/(gatewayStats.numUncoalescedMsgs*i2p::tunnel::TUNNEL_DATA_MAX_PAYLOAD_SIZE) << "% without coalescing)";
+		}	
+		else
+			s << "n/a";
+		s << ", coalescing window " << i2p::tunnel::GetTunnelGatewaysCoalescingWindow () << " us<br>";
+		auto endpointStats = i2p::tunnel::GetTunnelEndpointStats ();
+		s << "<b>Tunnel endpoints:</b> <i>" << endpointStats.numIncompleteMessages << "</i> incomplete messages, ";
+		s << endpointStats.reassemblyMemory/1024 << " KB, " << endpointStats.numExpiredMessages << " expired, ";
+		s << endpointStats.numEvictedMessages << " evicted, " << endpointStats.numDroppedFragments << " dropped fragments<br>";
+		auto& transitBandwidth = i2p::tunnel::transitBandwidthLimiter;
+		s << "<b>Transit bandwidth:</b> in <i>" << transitBandwidth.GetInboundRate ()/1024 << "</i> KBps";
+		if (transitBandwidth.GetInboundLimit ())
+			s << " of " << transitBandwidth.GetInboundLimit ()/1024;
+		s << ", out <i>" << transitBandwidth.GetOutboundRate ()/1024 << "</i> KBps";
+		if (transitBandwidth.GetOutboundLimit ())
+			s << " of " << transitBandwidth.GetOutboundLimit ()/1024;
+		s << ", share " << transitBandwidth.GetShare () << "%, " << transitBandwidth.GetNumDroppedMsgs () << " dropped messages, ";
+		s << transitBandwidth.GetNumRejectedTunnels () << " rejected tunnels<br>";
+		s << "<b>Peer profiles:</b> " << i2p::data::profiles.GetNumProfiles () << "<br>";
+		s << "<b>Tunnel builds:</b> <i>" << i2p::tunnel::tunnels.GetNumPendingTunnels () << "</i> pending, ";
+		s << i2p::tunnel::tunnels.GetBuildSuccessRate ()/10 << "% success, " << i2p::tunnel::tunnels.GetMeanBuildTime () << " ms average, ";
+		s << "rebuild " << i2p::tunnel::tunnels.GetRebuildLeadTime () << " s before expiration<br>";
 
 		s << "<br><b><a href=/?" << HTTP_COMMAND_LOCAL_DESTINATIONS << ">Local destinations</a></b>";
 		s << "<br><b><a href=/?" << HTTP_COMMAND_TUNNELS << ">Tunnels</a></b>";
@@ -748,15 +797,17 @@ namespace util
 	{
 		for (auto it: i2p::tunnel::tunnels.GetOutboundTunnels ())
 		{
-			it->GetTunnelConfig ()->Print (s);
-			if (it->GetTunnelPool () && !it->GetTunnelPool ()->IsExploratory ())
+			it.second->GetTunnelConfig ()->Print (s);
+			if (it.second->GetTunnelPool () && !it.second->GetTunnelPool ()->IsExploratory ())
 				s << " " << "Pool";
-			auto state = it->GetState ();
+			auto state = it.second->GetState ();
 			if (state == i2p::tunnel::eTunnelStateFailed)
 				s << " " << "Failed";
 			else if (state == i2p::tunnel::eTunnelStateExpiring)
 				s << " " << "Exp";
-			s << " " << (int)it->GetNumSentBytes () << "<br>";
+			if (it.second->GetMeanLatency ())
+				s << " " << it.second->GetMeanLatency () << "ms";
+			s << " " << (int)it.second->GetNumSentBytes () << "<br>";
 			s << std::endl;
 		}
 
@@ -770,6 +821,8 @@ namespace util
 				s << " " << "Failed";
 			else if (state == i2p::tunnel::eTunnelStateExpiring)
 				s << " " << "Exp";
+			if (it.second->GetMeanLatency ())
+				s << " " << it.second->GetMeanLatency () << "ms";
 			s << " " << (int)it.second->GetNumReceivedBytes () << "<br>";
 			s << std::endl;
 		}
@@ -820,6 +873,8 @@ namespace util
 						s << " " << "Failed";
 					else if (state == i2p::tunnel::eTunnelStateExpiring)
 						s << " " << "Exp";
+					if (it->GetMeanLatency ())
+						s << " " << it->GetMeanLatency () << "ms";
 					s << "<br>" << std::endl;
 				}
 				for (auto it: pool->GetInboundTunnels ())
@@ -830,6 +885,8 @@ namespace util
 						s << " " << "Failed";
 					else if (state == i2p::tunnel::eTunnelStateExpiring)
 						s << " " << "Exp";
+					if (it->GetMeanLatency ())
+						s << " " << it->GetMeanLatency () << "ms";
 					s << "<br>" << std::endl;
 				}
 			}	
@@ -1,7 +1,14 @@
 #include <string.h>
 #include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 #include "I2PEndian.h"
 #include <cryptopp/sha.h>
+#include "sha256.h"
 #include <cryptopp/gzip.h>
 #include "ElGamal.h"
 #include "Timestamp.h"
@@ -17,16 +24,159 @@ using namespace i2p::transport;
 
 namespace i2p
 {
+	template<int sz>
+	class I2NPMessagesPool
+	{
+		typedef I2NPMessageBuffer<sz> Buffer;
+
+		struct ThreadCache
+		{
+			I2NPMessagesPool<sz>& pool;
+			std::vector<Buffer *> buffers;
+
+			ThreadCache (I2NPMessagesPool<sz>& p): pool (p) {};
+			~ThreadCache () { pool.PutShared (buffers, buffers.size ()); }; // thread exits
+		};	
+		
+		public:
+
+			I2NPMessagesPool (size_t headroom, size_t maxCached, size_t maxShared): 
+				m_Headroom (headroom), m_MaxCached (maxCached), m_MaxShared (maxShared), 
+				m_Hits (0), m_Misses (0), m_InUse (0), m_HighWaterMark (0) {};
+			~I2NPMessagesPool ()
+			{
+				for (auto it: m_Shared)
+					delete it;
+			}	
+
+			I2NPMessage * Acquire ()
+			{
+				auto& cache = GetThreadCache ();
+				if (cache.buffers.empty ())
+					GetShared (cache.buffers, m_MaxCached/2);
+				Buffer * buffer;
+				if (!cache.buffers.empty ())
+				{
+					buffer = cache.buffers.back ();
+					cache.buffers.pop_back ();
+					m_Hits++;
+				}
+				else
+				{
+					buffer = new Buffer ();
+					m_Misses++;
+				}
+				// reset to state of newly created message
+				buffer->offset = m_Headroom;
+				buffer->len = m_Headroom + sizeof (I2NPHeader);
+				buffer->from = nullptr;
+				buffer->refCount = 1;
+				size_t inUse = ++m_InUse, highWaterMark = m_HighWaterMark;
+				while (inUse > highWaterMark && !m_HighWaterMark.compare_exchange_weak (highWaterMark, inUse));
+				return buffer;
+			}
+
+			void Release (I2NPMessage * msg)
+			{
+				m_InUse--;
+				auto& cache = GetThreadCache ();
+				cache.buffers.push_back (static_cast<Buffer *>(msg));
+				if (cache.buffers.size () > m_MaxCached)
+					PutShared (cache.buffers, m_MaxCached/2); // keep half for this thread
+			}
+
+			I2NPMessagesPoolStats GetStats ()
+			{
+				I2NPMessagesPoolStats stats;
+				stats.bufferSize = sz;
+				stats.hits = m_Hits;
+				stats.misses = m_Misses;
+				stats.inUse = m_InUse;
+				stats.highWaterMark = m_HighWaterMark;
+				std::unique_lock<std::mutex> l(m_SharedMutex);
+				stats.numShared = m_Shared.size ();
+				return stats;
+			}	
+
+		private:
+
+			ThreadCache& GetThreadCache ()
+			{
+				static thread_local ThreadCache cache (*this);
+				return cache;
+			}	
+
+			void GetShared (std::vector<Buffer *>& buffers, size_t num)
+			{
+				std::unique_lock<std::mutex> l(m_SharedMutex);
+				while (num > 0 && !m_Shared.empty ())
+				{
+					buffers.push_back (m_Shared.back ());
+					m_Shared.pop_back ();
+					num--;
+				}	
+			}
+
+			void PutShared (std::vector<Buffer *>& buffers, size_t num)
+			{
+				{
+					std::unique_lock<std::mutex> l(m_SharedMutex);
+					while (num > 0 && m_Shared.size () < m_MaxShared)
+					{
+						m_Shared.push_back (buffers.back ());
+						buffers.pop_back ();
+						num--;
+					}	
+				}	
+				// shared list is full, release memory 
+				for (; num > 0; num--)
+				{
+					delete buffers.back ();
+					buffers.pop_back ();
+				}	
+			}	
+			
+		private:
+
+			const size_t m_Headroom, m_MaxCached, m_MaxShared; // per thread, total
+			std::mutex m_SharedMutex;
+			std::vector<Buffer *> m_Shared;
+			std::atomic<size_t> m_Hits, m_Misses, m_InUse, m_HighWaterMark;
+	};	
+
+	static I2NPMessagesPool<I2NP_MAX_TUNNEL_MESSAGE_SIZE>& GetTunnelMessagesPool ()
+	{
+		static I2NPMessagesPool<I2NP_MAX_TUNNEL_MESSAGE_SIZE> pool (I2NP_TUNNEL_MESSAGE_HEADROOM, 256, 4096); 
+		return pool;
+	}
+
+	static I2NPMessagesPool<I2NP_MAX_SHORT_MESSAGE_SIZE>& GetShortMessagesPool ()
+	{
+		static I2NPMessagesPool<I2NP_MAX_SHORT_MESSAGE_SIZE> pool (I2NP_HEADROOM, 64, 512); 
+		return pool;
+	}
+
+	static I2NPMessagesPool<I2NP_MAX_MESSAGE_SIZE>& GetMessagesPool ()
+	{
+		static I2NPMessagesPool<I2NP_MAX_MESSAGE_SIZE> pool (I2NP_HEADROOM, 16, 64); 
+		return pool;
+	}
+	
 	I2NPMessage * NewI2NPMessage ()
 	{
-		return new I2NPMessageBuffer<I2NP_MAX_MESSAGE_SIZE>();
+		return GetMessagesPool ().Acquire ();
 	}
 	
 	I2NPMessage * NewI2NPShortMessage ()
 	{
-		return new I2NPMessageBuffer<I2NP_MAX_SHORT_MESSAGE_SIZE>();
+		return GetShortMessagesPool ().Acquire ();
 	}
 
+	I2NPMessage * NewI2NPTunnelMessage ()
+	{
+		return GetTunnelMessagesPool ().Acquire ();
+	}	
+
 	I2NPMessage * NewI2NPMessage (size_t len)
 	{
 		return (len < I2NP_MAX_SHORT_MESSAGE_SIZE/2) ? NewI2NPShortMessage () : NewI2NPMessage ();
@@ -34,7 +184,61 @@ namespace i2p
 	
 	void DeleteI2NPMessage (I2NPMessage * msg)
 	{
-		delete msg;
+		if (!msg) return;
+		if (msg->owner) // view
+		{
+			auto owner = msg->owner;
+			delete msg;
+			msg = owner;
+		}	
+		if (--msg->refCount > 0) return; // still referenced 
+		switch (msg->maxLen)
+		{
+			case I2NP_MAX_TUNNEL_MESSAGE_SIZE:
+				GetTunnelMessagesPool ().Release (msg);
+			break;
+			case I2NP_MAX_SHORT_MESSAGE_SIZE:
+				GetShortMessagesPool ().Release (msg);
+			break;	
+			case I2NP_MAX_MESSAGE_SIZE:
+				GetMessagesPool ().Release (msg);
+			break;	
+			default:
+				LogPrint (eLogError, "I2NP message of unknown size ", msg->maxLen);
+		}	
+	}	
+
+	I2NPMessage * ShareI2NPMessage (I2NPMessage * msg)
+	{
+		auto owner = msg->owner ? msg->owner : msg;
+		owner->refCount++;
+		auto view = new I2NPMessage ();
+		view->buf = msg->buf;
+		view->len = msg->len;
+		view->offset = msg->offset;
+		view->maxLen = msg->maxLen;
+		view->from = msg->from;
+		view->owner = owner;
+		return view;
+	}	
+
+	I2NPMessage * UnshareI2NPMessage (I2NPMessage * msg)
+	{
+		if (!msg || !msg->IsShared ()) return msg;
+		auto copy = NewI2NPMessage (msg->GetLength ());
+		*copy = *msg;
+		DeleteI2NPMessage (msg);
+		return copy;
+	}	
+
+	std::vector<I2NPMessagesPoolStats> GetI2NPMessagesPoolStats ()
+	{
+		return std::vector<I2NPMessagesPoolStats>
+		{
+			GetTunnelMessagesPool ().GetStats (),
+			GetShortMessagesPool ().GetStats (),
+			GetMessagesPool ().GetStats ()
+		};	
 	}	
 
 	static std::atomic<uint32_t> I2NPmsgID(0); // TODO: create class
@@ -52,9 +256,7 @@ namespace i2p
 		header->expiration = htobe64 (i2p::util::GetMillisecondsSinceEpoch () + 5000); // TODO: 5 secs is a magic number
 		int len = msg->GetLength () - sizeof (I2NPHeader);
 		header->size = htobe16 (len);
-		uint8_t hash[32];
-		CryptoPP::SHA256().CalculateDigest(hash, msg->GetPayload (), len);
-		header->chks = hash[0];
+		header->chks = 0; // calculated where long header is sent, most messages go to SSU or stay local
 	}	
 
 	void RenewI2NPMessageHeader (I2NPMessage * msg)
@@ -282,7 +484,10 @@ namespace i2p
 		memcpy (record.toPeer, (const uint8_t *)router.GetIdentHash (), 16);
 	}	
 	
-	bool HandleBuildRequestRecords (int num, I2NPBuildRequestRecordElGamalEncrypted * records, I2NPBuildRequestRecordClearText& clearText)
+	static void UpdateTunnelBuildDecryptTime (uint64_t t);
+
+	bool HandleBuildRequestRecords (int num, I2NPBuildRequestRecordElGamalEncrypted * records, 
+		I2NPBuildRequestRecordClearText& clearText, bool accept)
 	{
 		for (int i = 0; i < num; i++)
 		{	
@@ -290,10 +495,14 @@ namespace i2p
 			{	
 				LogPrint ("Record ",i," is ours");	
 			
+				auto ts = std::chrono::steady_clock::now ();
 				i2p::crypto::ElGamalDecrypt (i2p::context.GetEncryptionPrivateKey (), records[i].encrypted, (uint8_t *)&clearText);
+				UpdateTunnelBuildDecryptTime (std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now () - ts).count ());
 				// replace record to reply
 				I2NPBuildResponseRecord * reply = (I2NPBuildResponseRecord *)(records + i);				
-				if (i2p::context.AcceptsTunnels ())
+				if (accept && i2p::context.AcceptsTunnels () && 
+					i2p::tunnel::transitBandwidthLimiter.AcceptsNewTunnel ())
 				{	
 					i2p::tunnel::TransitTunnel * transitTunnel = 
 						i2p::tunnel::CreateTransitTunnel (
@@ -305,10 +514,10 @@ namespace i2p
 					reply->ret = 0;
 				}
 				else
-					reply->ret = 30; // always reject with bandwidth reason (30)
+					reply->ret = i2p::tunnel::TRANSIT_BANDWIDTH_REJECT_CODE; // always reject with bandwidth reason
 				
 				//TODO: fill filler
-				CryptoPP::SHA256().CalculateDigest(reply->hash, reply->padding, sizeof (reply->padding) + 1); // + 1 byte of ret
+				i2p::crypto::SHA256 (reply->padding, sizeof (reply->padding) + 1, reply->hash); // + 1 byte of ret
 				// encrypt reply
 				i2p::crypto::CBCEncryption encryption;
 				for (int j = 0; j < num; j++)
@@ -323,33 +532,36 @@ namespace i2p
 		return false;
 	}
 
-	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len)
-	{	
-		int num = buf[0];
-		LogPrint ("VariableTunnelBuild ", num, " records");
-
+	static bool HandleInboundTunnelBuildReply (uint32_t replyMsgID, uint8_t * buf, size_t len)
+	{
 		i2p::tunnel::Tunnel * tunnel =  i2p::tunnel::tunnels.GetPendingTunnel (replyMsgID);
-		if (tunnel)
+		if (!tunnel) return false;
+		// endpoint of inbound tunnel
+		LogPrint ("VariableTunnelBuild reply for tunnel ", tunnel->GetTunnelID ());
+		if (tunnel->HandleTunnelBuildResponse (buf, len))
 		{
-			// endpoint of inbound tunnel
-			LogPrint ("VariableTunnelBuild reply for tunnel ", tunnel->GetTunnelID ());
-			if (tunnel->HandleTunnelBuildResponse (buf, len))
-			{
-				LogPrint ("Inbound tunnel ", tunnel->GetTunnelID (), " has been created");
-				tunnel->SetState (i2p::tunnel::eTunnelStateEstablished);	
-				i2p::tunnel::tunnels.AddInboundTunnel (static_cast<i2p::tunnel::InboundTunnel *>(tunnel));
-			}
-			else
-			{
-				LogPrint ("Inbound tunnel ", tunnel->GetTunnelID (), " has been declined");
-				tunnel->SetState (i2p::tunnel::eTunnelStateBuildFailed);	
-			}
+			LogPrint ("Inbound tunnel ", tunnel->GetTunnelID (), " has been created");
+			tunnel->SetState (i2p::tunnel::eTunnelStateEstablished);	
+			i2p::tunnel::tunnels.AddInboundTunnel (static_cast<i2p::tunnel::InboundTunnel *>(tunnel));
 		}
 		else
+		{
+			LogPrint ("Inbound tunnel ", tunnel->GetTunnelID (), " has been declined");
+			tunnel->SetState (i2p::tunnel::eTunnelStateBuildFailed);	
+		}
+		return true;
+	}	
+
+	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len, bool accept)
+	{	
+		int num = buf[0];
+		LogPrint ("VariableTunnelBuild ", num, " records");
+
+		if (!HandleInboundTunnelBuildReply (replyMsgID, buf, len))
 		{
 			I2NPBuildRequestRecordElGamalEncrypted * records = (I2NPBuildRequestRecordElGamalEncrypted *)(buf+1); 
 			I2NPBuildRequestRecordClearText clearText;	
-			if (HandleBuildRequestRecords (num, records, clearText))
+			if (HandleBuildRequestRecords (num, records, clearText, accept))
 			{
 				if (clearText.flag & 0x40) // we are endpoint of outboud tunnel
 				{
@@ -366,10 +578,10 @@ namespace i2p
 		}	
 	}
 
-	void HandleTunnelBuildMsg (uint8_t * buf, size_t len)
+	void HandleTunnelBuildMsg (uint8_t * buf, size_t len, bool accept)
 	{
 		I2NPBuildRequestRecordClearText clearText;	
-		if (HandleBuildRequestRecords (NUM_TUNNEL_BUILD_RECORDS, (I2NPBuildRequestRecordElGamalEncrypted *)buf, clearText))
+		if (HandleBuildRequestRecords (NUM_TUNNEL_BUILD_RECORDS, (I2NPBuildRequestRecordElGamalEncrypted *)buf, clearText, accept))
 		{
 			if (clearText.flag & 0x40) // we are endpoint of outbound tunnel
 			{
@@ -408,10 +620,182 @@ namespace i2p
 			LogPrint ("Pending tunnel for message ", replyMsgID, " not found");
 	}
 
+	class TunnelBuildWorkers
+	{
+		public:
+
+			TunnelBuildWorkers (): m_IsRunning (false), m_NumTurns (0)
+			{
+				memset (&m_Stats, 0, sizeof (m_Stats));
+			}	
+			~TunnelBuildWorkers () { Stop (); };
+
+			void Start ()
+			{
+				m_IsRunning = true;
+				for (int i = 0; i < TUNNEL_BUILD_NUM_WORKERS; i++)
+					m_Threads.push_back (new std::thread (std::bind (&TunnelBuildWorkers::Run, this)));
+			}
+
+			void Stop ()
+			{
+				{
+					std::unique_lock<std::mutex> l(m_QueueMutex);
+					m_IsRunning = false;
+					m_NonEmpty.notify_all ();
+				}	
+				for (auto it: m_Threads)
+				{
+					it->join ();
+					delete it;
+				}	
+				m_Threads.clear ();
+				for (auto& it: m_Queue)
+					DeleteI2NPMessage (it.second);
+				m_Queue.clear ();
+				for (auto& it: m_Rejects)
+					DeleteI2NPMessage (it.second);
+				m_Rejects.clear ();
+			}
+
+			bool Post (I2NPMessage * msg)
+			{
+				auto ts = i2p::util::GetSecondsSinceEpoch ();
+				std::unique_lock<std::mutex> l(m_QueueMutex);
+				if (!m_IsRunning) return false;
+				if (m_Queue.size () < TUNNEL_BUILD_QUEUE_SIZE)
+					m_Queue.push_back (std::make_pair (ts, msg));
+				else if (m_Rejects.size () < TUNNEL_BUILD_QUEUE_SIZE)
+				{
+					// reply with rejection instead of letting it time out
+					m_Rejects.push_back (std::make_pair (ts, msg));
+					m_Stats.rejected++;
+				}	
+				else
+				{
+					LogPrint ("Tunnel build queue is full. Dropped");
+					DeleteI2NPMessage (msg);
+					m_Stats.dropped++;
+					return true;
+				}	
+				m_NonEmpty.notify_one ();
+				return true;
+			}	
+
+			void UpdateDecryptTime (uint64_t t)
+			{
+				std::unique_lock<std::mutex> l(m_QueueMutex);
+				m_Stats.avgDecryptTime = m_Stats.avgDecryptTime ? (m_Stats.avgDecryptTime*7 + t)/8 : t;
+				if (t > m_Stats.maxDecryptTime) m_Stats.maxDecryptTime = t;
+			}	
+
+			TunnelBuildWorkersStats GetStats ()
+			{
+				std::unique_lock<std::mutex> l(m_QueueMutex);
+				TunnelBuildWorkersStats stats = m_Stats;
+				stats.queued = m_Queue.size () + m_Rejects.size ();
+				return stats;
+			}	
+
+		private:
+
+			void Run ()
+			{
+				std::unique_lock<std::mutex> l(m_QueueMutex);
+				while (m_IsRunning)
+				{
+					if (m_Queue.empty () && m_Rejects.empty ())
+					{
+						m_NonEmpty.wait (l);
+						continue;
+					}	
+					// rejection costs decryption as well, accepted requests first, 
+					// but rejects get their turn otherwise they would be expired under load
+					m_NumTurns++;
+					bool accept = !m_Queue.empty () && (m_Rejects.empty () || m_NumTurns % TUNNEL_BUILD_REJECTS_TURN);
+					auto& queue = accept ? m_Queue : m_Rejects;
+					auto postedAt = queue.front ().first;
+					auto msg = queue.front ().second;
+					queue.pop_front ();
+					if (i2p::util::GetSecondsSinceEpoch () > postedAt + i2p::tunnel::TUNNEL_CREATION_TIMEOUT)
+					{
+						// nobody waits for reply, don't spend ElGamal decryption on it
+						DeleteI2NPMessage (msg);
+						m_Stats.expired++;
+						continue;
+					}	
+					l.unlock ();
+					Handle (msg, accept);
+					l.lock ();
+					m_Stats.processed++;
+				}	
+			}	
+
+		public:
+
+			static void Handle (I2NPMessage * msg, bool accept)
+			{
+				I2NPHeader * header = msg->GetHeader ();
+				uint8_t * buf = msg->GetPayload ();
+				size_t len = be16toh (header->size);
+				if (header->typeID == eI2NPVariableTunnelBuild)
+					HandleVariableTunnelBuildMsg (be32toh (header->msgID), buf, len, accept);
+				else
+					HandleTunnelBuildMsg (buf, len, accept);
+				DeleteI2NPMessage (msg);
+			}	
+
+		private:
+
+			bool m_IsRunning;
+			uint64_t m_NumTurns;
+			std::deque<std::pair<uint64_t, I2NPMessage *> > m_Queue, m_Rejects; // with time posted in seconds
+			std::mutex m_QueueMutex;
+			std::condition_variable m_NonEmpty;
+			std::vector<std::thread *> m_Threads;
+			TunnelBuildWorkersStats m_Stats;
+	};	
+
+	static TunnelBuildWorkers tunnelBuildWorkers;
+
+	static void UpdateTunnelBuildDecryptTime (uint64_t t)
+	{
+		tunnelBuildWorkers.UpdateDecryptTime (t);
+	}	
+
+	void StartTunnelBuildWorkers ()
+	{
+		tunnelBuildWorkers.Start ();
+	}
+
+	void StopTunnelBuildWorkers ()
+	{
+		tunnelBuildWorkers.Stop ();
+	}
+
+	void PostTunnelBuildMsg (I2NPMessage * msg)
+	{
+		I2NPHeader * header = msg->GetHeader ();
+		if (header->typeID == eI2NPVariableTunnelBuild && 
+			HandleInboundTunnelBuildReply (be32toh (header->msgID), msg->GetPayload (), be16toh (header->size)))
+		{
+			// reply for our inbound tunnel, symmetric decryption only, must not wait or be rejected
+			DeleteI2NPMessage (msg);
+			return;
+		}	
+		if (!tunnelBuildWorkers.Post (msg))
+			TunnelBuildWorkers::Handle (msg, true); 
+	}	
+
+	TunnelBuildWorkersStats GetTunnelBuildWorkersStats ()
+	{
+		return tunnelBuildWorkers.GetStats ();
+	}	
+
 
 	I2NPMessage * CreateTunnelDataMsg (const uint8_t * buf)
 	{
-		I2NPMessage * msg = NewI2NPMessage ();
+		I2NPMessage * msg = NewI2NPTunnelMessage ();
 		memcpy (msg->GetPayload (), buf, i2p::tunnel::TUNNEL_DATA_MSG_SIZE);
 		msg->len += i2p::tunnel::TUNNEL_DATA_MSG_SIZE; 
 		FillI2NPMessageHeader (msg, eI2NPTunnelData);
@@ -420,7 +804,7 @@ namespace i2p
 
 	I2NPMessage * CreateTunnelDataMsg (uint32_t tunnelID, const uint8_t * payload)	
 	{
-		I2NPMessage * msg = NewI2NPMessage ();
+		I2NPMessage * msg = NewI2NPTunnelMessage ();
 		memcpy (msg->GetPayload () + 4, payload, i2p::tunnel::TUNNEL_DATA_MSG_SIZE - 4);
 		*(uint32_t *)(msg->GetPayload ()) = htobe32 (tunnelID);
 		msg->len += i2p::tunnel::TUNNEL_DATA_MSG_SIZE; 
@@ -442,20 +826,21 @@ namespace i2p
 
 	I2NPMessage * CreateTunnelGatewayMsg (uint32_t tunnelID, I2NPMessage * msg)
 	{
-		if (msg->offset >= sizeof (I2NPHeader) + sizeof (TunnelGatewayHeader))
+		if (msg->GetHeadroom () >= I2NP_HEADROOM && !msg->IsShared ())
 		{
 			// message is capable to be used without copying
-			TunnelGatewayHeader * header = (TunnelGatewayHeader *)(msg->GetBuffer () - sizeof (TunnelGatewayHeader));
-			header->tunnelID = htobe32 (tunnelID);
+			msg->UpdateChks (); // long header goes into gateway message
 			int len = msg->GetLength ();
+			TunnelGatewayHeader * header = (TunnelGatewayHeader *)msg->Prepend (sizeof (TunnelGatewayHeader));
+			header->tunnelID = htobe32 (tunnelID);
 			header->length = htobe16 (len);
-			msg->offset -= (sizeof (I2NPHeader) + sizeof (TunnelGatewayHeader));
-			msg->len = msg->offset + sizeof (I2NPHeader) + sizeof (TunnelGatewayHeader) +len;
+			msg->Prepend (sizeof (I2NPHeader));
 			FillI2NPMessageHeader (msg, eI2NPTunnelGateway);
 			return msg;
 		}
 		else
 		{	
+			msg->UpdateChks ();
 			I2NPMessage * msg1 = CreateTunnelGatewayMsg (tunnelID, msg->GetBuffer (), msg->GetLength ());
 			DeleteI2NPMessage (msg);
 			return msg1;
@@ -472,6 +857,7 @@ namespace i2p
 		memcpy (msg->GetPayload (), buf, len);
 		msg->len += len;
 		FillI2NPMessageHeader (msg, msgType, replyMsgID); // create content message
+		msg->UpdateChks ();
 		len = msg->GetLength ();
 		msg->offset -= gatewayMsgOffset;
 		TunnelGatewayHeader * header = (TunnelGatewayHeader *)msg->GetPayload ();
@@ -495,9 +881,7 @@ namespace i2p
 		{
 			// transit DatabaseStore my contain new/updated RI 
 			// or DatabaseSearchReply with new routers
-			auto ds = NewI2NPMessage ();
-			*ds = *msg;
-			i2p::data::netdb.PostI2NPMsg (ds);
+			i2p::data::netdb.PostI2NPMsg (ShareI2NPMessage (msg)); // gateway only reads msg
 		}	
 		i2p::tunnel::TransitTunnel * tunnel =  i2p::tunnel::tunnels.GetTransitTunnel (tunnelID);
 		if (tunnel)
@@ -558,7 +942,7 @@ namespace i2p
 				break;	
 				case eI2NPTunnelGateway:
 					LogPrint ("TunnelGateway");
-					HandleTunnelGatewayMsg (msg);
+					i2p::tunnel::tunnels.PostTunnelData (msg); // handled by tunnel's worker
 				break;
 				case eI2NPGarlic:
 					LogPrint ("Garlic");
@@ -573,6 +957,11 @@ namespace i2p
 					// forward to netDb
 					i2p::data::netdb.PostI2NPMsg (msg);
 				break;
+				case eI2NPVariableTunnelBuild:
+				case eI2NPTunnelBuild:
+					// ElGamal decryption, don't block caller's thread
+					PostTunnelBuildMsg (msg);
+				break;	
 				case eI2NPDeliveryStatus:
 					LogPrint ("DeliveryStatus");
 					if (msg->from && msg->from->GetTunnelPool ())
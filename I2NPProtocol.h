@@ -3,8 +3,11 @@
 
 #include <inttypes.h>
 #include <set>
+#include <vector>
+#include <atomic>
 #include <string.h>
 #include "I2PEndian.h"
+#include "sha256.h"
 #include "RouterInfo.h"
 #include "LeaseSet.h"
 
@@ -104,20 +107,43 @@ namespace tunnel
 
 	const size_t I2NP_MAX_MESSAGE_SIZE = 32768; 
 	const size_t I2NP_MAX_SHORT_MESSAGE_SIZE = 2400; 
+	const size_t I2NP_MAX_TUNNEL_MESSAGE_SIZE = 1056; // 2 (NTCP size) + 16 (header) + 1028 (tunnel data) + 4 (NTCP checksum), 16 bytes aligned
+	const size_t I2NP_HEADROOM = 2 + sizeof (I2NPHeader) + sizeof (TunnelGatewayHeader); // NTCP size + TunnelGateway headers
+	const size_t I2NP_TUNNEL_MESSAGE_HEADROOM = 2; // NTCP size only, tunnel data is never wrapped
+
+	// NTCP frames message in place: size goes before it, padding and checksum after, 16 bytes aligned
+	inline bool IsNTCPFrameFitting (size_t headroom, size_t len, size_t maxLen)
+	{
+		return headroom >= 2 && headroom - 2 + ((len + 6 + 0x0F) & ~0x0F) <= maxLen;
+	}	
+	const int TUNNEL_BUILD_NUM_WORKERS = 2;
+	const size_t TUNNEL_BUILD_QUEUE_SIZE = 64; // pending requests, next are rejected, as many rejects as well, rest are dropped
+	const int TUNNEL_BUILD_REJECTS_TURN = 4; // every 4th request handled is a rejection if any
 	struct I2NPMessage
 	{	
 		uint8_t * buf;	
 		size_t len, offset, maxLen;
 		i2p::tunnel::InboundTunnel * from;
+		std::atomic<int> refCount; // references to buf
+		I2NPMessage * owner; // message buf belongs to if shared view, nullptr otherwise 
+		I2NPMessage * next; // in MPSCQueue
 		
 		I2NPMessage (): buf (nullptr),len (sizeof (I2NPHeader) + 2), 
-			offset(2), maxLen (0), from (nullptr) {}; 
+			offset(2), maxLen (0), from (nullptr), refCount (1), owner (nullptr), next (nullptr) {}; 
 		// reserve 2 bytes for NTCP header
 		I2NPHeader * GetHeader () { return (I2NPHeader *)GetBuffer (); };
 		uint8_t * GetPayload () { return GetBuffer () + sizeof(I2NPHeader); };
 		uint8_t * GetBuffer () { return buf + offset; };
 		const uint8_t * GetBuffer () const { return buf + offset; };
 		size_t GetLength () const { return len - offset; };
+		size_t GetHeadroom () const { return offset; };
+		size_t GetTailroom () const { return maxLen - len; };
+		bool IsShared () const { return owner || refCount > 1; }; // buf must not be modified if shared
+		uint8_t * Prepend (size_t l) // caller checks headroom
+		{
+			offset -= l;
+			return GetBuffer ();
+		}
 		void Align (size_t alignment) 
 		{
 			size_t rem = ((size_t)GetBuffer ()) % alignment;
@@ -136,6 +162,14 @@ namespace tunnel
 			return *this;
 		}	
 
+		// lazy, before long header is sent over NTCP, put into garlic clove, tunnel fragment or gateway message
+		void UpdateChks ()
+		{
+			uint8_t hash[32];
+			i2p::crypto::SHA256 (GetPayload (), GetLength () - sizeof (I2NPHeader), hash);
+			GetHeader ()->chks = hash[0];
+		}	
+
 		// for SSU only
 		uint8_t * GetSSUHeader () { return buf + offset + sizeof(I2NPHeader) - sizeof(I2NPHeaderShort); };	
 		void FromSSU (uint32_t msgID) // we have received SSU message and convert it to regular
@@ -166,10 +200,22 @@ namespace tunnel
 		uint8_t m_Buffer[sz];
 	};
 
+	struct I2NPMessagesPoolStats
+	{
+		size_t bufferSize;
+		size_t hits, misses; // taken from cache or allocated
+		size_t inUse, highWaterMark; 
+		size_t numShared; // buffers in shared free list, per-thread caches are not counted
+	};	
+
 	I2NPMessage * NewI2NPMessage ();
 	I2NPMessage * NewI2NPShortMessage ();
+	I2NPMessage * NewI2NPTunnelMessage ();
 	I2NPMessage * NewI2NPMessage (size_t len);
-	void DeleteI2NPMessage (I2NPMessage * msg);
+	void DeleteI2NPMessage (I2NPMessage * msg); // releases one reference
+	I2NPMessage * ShareI2NPMessage (I2NPMessage * msg); // read-only view of the same buffer, released by DeleteI2NPMessage
+	I2NPMessage * UnshareI2NPMessage (I2NPMessage * msg); // copies if shared, returned message can be modified in place
+	std::vector<I2NPMessagesPoolStats> GetI2NPMessagesPoolStats ();
 	void FillI2NPMessageHeader (I2NPMessage * msg, I2NPMessageType msgType, uint32_t replyMsgID = 0);
 	void RenewI2NPMessageHeader (I2NPMessage * msg);
 	I2NPMessage * CreateI2NPMessage (I2NPMessageType msgType, const uint8_t * buf, int len, uint32_t replyMsgID = 0);	
@@ -195,10 +241,24 @@ namespace tunnel
 		const I2NPBuildRequestRecordClearText& clearText,
 	    I2NPBuildRequestRecordElGamalEncrypted& record);
 	
-	bool HandleBuildRequestRecords (int num, I2NPBuildRequestRecordElGamalEncrypted * records, I2NPBuildRequestRecordClearText& clearText);
-	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len);
+	bool HandleBuildRequestRecords (int num, I2NPBuildRequestRecordElGamalEncrypted * records, 
+		I2NPBuildRequestRecordClearText& clearText, bool accept = true);
+	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len, bool accept = true);
 	void HandleVariableTunnelBuildReplyMsg (uint32_t replyMsgID, uint8_t * buf, size_t len);
-	void HandleTunnelBuildMsg (uint8_t * buf, size_t len);	
+	void HandleTunnelBuildMsg (uint8_t * buf, size_t len, bool accept = true);	
+
+	struct TunnelBuildWorkersStats
+	{
+		size_t queued, processed;
+		size_t rejected, dropped; // because of full queue
+		size_t expired; // not decrypted, sender has given up already
+		uint64_t avgDecryptTime, maxDecryptTime; // ElGamal of our record in microseconds, average is moving
+	};	
+
+	void StartTunnelBuildWorkers ();
+	void StopTunnelBuildWorkers ();
+	void PostTunnelBuildMsg (I2NPMessage * msg); // handled by workers, inline if not started
+	TunnelBuildWorkersStats GetTunnelBuildWorkersStats ();
 
 	I2NPMessage * CreateTunnelDataMsg (const uint8_t * buf);	
 	I2NPMessage * CreateTunnelDataMsg (uint32_t tunnelID, const uint8_t * payload);		
@@ -1,5 +1,8 @@
 #include <time.h>
 #include <stdio.h>
+#include <list>
+#include <unordered_map>
+#include <mutex>
 #include <cryptopp/sha.h>
 #include <cryptopp/osrng.h>
 #include <cryptopp/dsa.h>
@@ -139,7 +142,6 @@ namespace data
 		
 	IdentityEx::~IdentityEx ()
 	{
-		delete m_Verifier;
 		delete[] m_ExtendedBuffer;
 	}	
 
@@ -158,7 +160,6 @@ namespace data
 		else
 			m_ExtendedBuffer = nullptr;
 		
-		delete m_Verifier;
 		m_Verifier = nullptr;
 		
 		return *this;
@@ -173,7 +174,6 @@ namespace data
 		m_ExtendedBuffer = nullptr;
 		m_ExtendedLen = 0;
 
-		delete m_Verifier;
 		m_Verifier = nullptr;
 		
 		return *this;
@@ -210,7 +210,6 @@ namespace data
 		}	
 		CryptoPP::SHA256().CalculateDigest(m_IdentHash, buf, GetFullLen ());
 		
-		delete m_Verifier;
 		m_Verifier = nullptr;
 		
 		return GetFullLen ();
@@ -288,22 +287,34 @@ namespace data
 		
 	void IdentityEx::CreateVerifier () const 
 	{
+		// signing key type, signing key and excess of signing key if any
+		auto keyType = GetSigningKeyType ();
+		std::string key ((const char *)&keyType, sizeof (keyType));
+		key.append ((const char *)m_StandardIdentity.signingKey, sizeof (m_StandardIdentity.signingKey));
+		if (m_ExtendedLen > 4 && m_ExtendedBuffer)
+			key.append ((const char *)m_ExtendedBuffer + 4, m_ExtendedLen - 4); 
+		m_Verifier = GetCachedVerifier (key, std::bind (&IdentityEx::NewVerifier, this));
+	}	
+
+	i2p::crypto::Verifier * IdentityEx::NewVerifier () const 
+	{
+		i2p::crypto::Verifier * verifier = nullptr;
 		auto keyType = GetSigningKeyType ();
 		switch (keyType)
 		{
 			case SIGNING_KEY_TYPE_DSA_SHA1:
-				m_Verifier = new i2p::crypto::DSAVerifier (m_StandardIdentity.signingKey);
+				verifier = new i2p::crypto::DSAVerifier (m_StandardIdentity.signingKey);
 			break;
 			case SIGNING_KEY_TYPE_ECDSA_SHA256_P256:
 			{	
 				size_t padding =  128 - i2p::crypto::ECDSAP256_KEY_LENGTH; // 64 = 128 - 64
-				m_Verifier = new i2p::crypto::ECDSAP256Verifier (m_StandardIdentity.signingKey + padding);
+				verifier = new i2p::crypto::ECDSAP256Verifier (m_StandardIdentity.signingKey + padding);
 				break;
 			}	
 			case SIGNING_KEY_TYPE_ECDSA_SHA384_P384:
 			{	
 				size_t padding = 128 - i2p::crypto::ECDSAP384_KEY_LENGTH; // 32 = 128 - 96
-				m_Verifier = new i2p::crypto::ECDSAP384Verifier (m_StandardIdentity.signingKey + padding);
+				verifier = new i2p::crypto::ECDSAP384Verifier (m_StandardIdentity.signingKey + padding);
 				break;
 			}	
 			case SIGNING_KEY_TYPE_ECDSA_SHA512_P521:
@@ -312,7 +323,7 @@ namespace data
 				memcpy (signingKey, m_StandardIdentity.signingKey, 128);
 				size_t excessLen = i2p::crypto::ECDSAP521_KEY_LENGTH - 128; // 4 = 132- 128
 				memcpy (signingKey + 128, m_ExtendedBuffer + 4, excessLen); // right after signing and crypto key types
-				m_Verifier = new i2p::crypto::ECDSAP521Verifier (signingKey);
+				verifier = new i2p::crypto::ECDSAP521Verifier (signingKey);
 				break;
 			}		
 			case SIGNING_KEY_TYPE_RSA_SHA256_2048:
@@ -321,7 +332,7 @@ namespace data
 				memcpy (signingKey, m_StandardIdentity.signingKey, 128);
 				size_t excessLen = i2p::crypto::RSASHA2562048_KEY_LENGTH - 128; // 128 = 256- 128
 				memcpy (signingKey + 128, m_ExtendedBuffer + 4, excessLen); // right after signing and crypto key types
-				m_Verifier = new i2p::crypto:: RSASHA2562048Verifier (signingKey);
+				verifier = new i2p::crypto:: RSASHA2562048Verifier (signingKey);
 				break;
 			}	
 			case SIGNING_KEY_TYPE_RSA_SHA384_3072:
@@ -330,7 +341,7 @@ namespace data
 				memcpy (signingKey, m_StandardIdentity.signingKey, 128);
 				size_t excessLen = i2p::crypto::RSASHA3843072_KEY_LENGTH - 128; // 256 = 384- 128
 				memcpy (signingKey + 128, m_ExtendedBuffer + 4, excessLen); // right after signing and crypto key types
-				m_Verifier = new i2p::crypto:: RSASHA3843072Verifier (signingKey);
+				verifier = new i2p::crypto:: RSASHA3843072Verifier (signingKey);
 				break;
 			}	
 			case SIGNING_KEY_TYPE_RSA_SHA512_4096:
@@ -339,21 +350,129 @@ namespace data
 				memcpy (signingKey, m_StandardIdentity.signingKey, 128);
 				size_t excessLen = i2p::crypto::RSASHA5124096_KEY_LENGTH - 128; // 384 = 512- 128
 				memcpy (signingKey + 128, m_ExtendedBuffer + 4, excessLen); // right after signing and crypto key types
-				m_Verifier = new i2p::crypto:: RSASHA5124096Verifier (signingKey);
+				verifier = new i2p::crypto:: RSASHA5124096Verifier (signingKey);
 				break;
 			}		
 			default:
 				LogPrint ("Signing key type ", (int)keyType, " is not supported");
 		}			
+		return verifier;
 	}	
 	
 	void IdentityEx::DropVerifier ()
 	{
-		auto verifier = m_Verifier;
 		m_Verifier = nullptr; // TODO: make this atomic
-		delete verifier;
 	}
 
+	class VerifiersCache
+	{
+		struct Entry
+		{
+			std::string key;
+			std::shared_ptr<i2p::crypto::Verifier> verifier;
+			int numUses;
+			bool isReplaced; // by precomputed, only once since not every verifier supports it
+		};	
+		
+		public:
+
+			VerifiersCache (): m_NumHits (0), m_NumMisses (0) {};
+
+			std::shared_ptr<const i2p::crypto::Verifier> Get (const std::string& key, 
+				std::function<i2p::crypto::Verifier * ()> create);
+			VerifiersCacheStats GetStats ();
+
+		private:
+
+			std::mutex m_Mutex;
+			std::list<Entry> m_Entries; // most recently used first
+			std::unordered_map<std::string, std::list<Entry>::iterator> m_Index;
+			size_t m_NumHits, m_NumMisses;
+	};
+
+	std::shared_ptr<const i2p::crypto::Verifier> VerifiersCache::Get (const std::string& key, 
+		std::function<i2p::crypto::Verifier * ()> create)
+	{
+		{
+			std::unique_lock<std::mutex> l(m_Mutex);
+			auto it = m_Index.find (key);
+			if (it != m_Index.end ())
+			{
+				m_NumHits++;
+				auto entry = it->second;
+				m_Entries.splice (m_Entries.begin (), m_Entries, entry);
+				std::shared_ptr<const i2p::crypto::Verifier> verifier = entry->verifier;
+				if (entry->isReplaced || ++entry->numUses < VERIFIER_PRECOMPUTATION_THRESHOLD)
+					return verifier;
+				entry->isReplaced = true;	
+			}
+			else
+			{	
+				m_NumMisses++;
+				l.unlock ();
+				auto v = create ();
+				if (!v) return nullptr; // unsupported signing key type
+				std::shared_ptr<i2p::crypto::Verifier> verifier (v);
+				l.lock ();
+				it = m_Index.find (key);
+				if (it != m_Index.end ()) // inserted by another thread meanwhile 
+					return it->second->verifier;
+				m_Entries.push_front ({ key, verifier, 1, false });
+				m_Index[key] = m_Entries.begin ();
+				if (m_Entries.size () > VERIFIERS_CACHE_SIZE)
+				{
+					// evict least recently used
+					m_Index.erase (m_Entries.back ().key);
+					m_Entries.pop_back ();
+				}	
+				return verifier;
+			}	
+		}
+		// hot key. Precompute a fresh verifier, because cached one might be in use by other threads
+		std::shared_ptr<i2p::crypto::Verifier> verifier (create ());
+		verifier->Precompute ();
+		std::unique_lock<std::mutex> l(m_Mutex);
+		auto it = m_Index.find (key);
+		if (it != m_Index.end ())
+			it->second->verifier = verifier;
+		return verifier;
+	}	
+
+	VerifiersCacheStats VerifiersCache::GetStats ()
+	{
+		VerifiersCacheStats stats;
+		std::unique_lock<std::mutex> l(m_Mutex);
+		stats.size = m_Entries.size ();
+		stats.numPrecomputed = 0; stats.memoryUsage = 0;
+		for (auto& it: m_Entries)
+		{
+			// rough estimation, precomputed tables keep about 32 multiples of public key
+			size_t keyLen = it.verifier->GetPublicKeyLen ();
+			if (it.verifier->IsPrecomputed ())
+			{
+				stats.numPrecomputed++;
+				keyLen *= 33;
+			}	
+			stats.memoryUsage += it.key.length () + keyLen + sizeof (Entry) + 64;
+		}	
+		stats.hits = m_NumHits;
+		stats.misses = m_NumMisses;
+		return stats;
+	}	
+
+	static VerifiersCache verifiersCache;
+
+	std::shared_ptr<const i2p::crypto::Verifier> GetCachedVerifier (const std::string& key, 
+		std::function<i2p::crypto::Verifier * ()> create)
+	{
+		return verifiersCache.Get (key, create);
+	}	
+
+	VerifiersCacheStats GetVerifiersCacheStats ()
+	{
+		return verifiersCache.GetStats ();
+	}	
+
 	PrivateKeys& PrivateKeys::operator=(const Keys& keys)
 	{
 		m_Public = Identity (keys);
@@ -493,8 +612,7 @@ namespace data
 			}	
 			// encryption
 			uint8_t publicKey[256];
-			CryptoPP::DH dh (i2p::crypto::elgp, i2p::crypto::elgg);
-			dh.GenerateKeyPair(rnd, keys.m_PrivateKey, publicKey);
+			i2p::crypto::GenerateElGamalKeyPair (rnd, keys.m_PrivateKey, publicKey);
 			// identity
 			keys.m_Public = IdentityEx (publicKey, signingPublicKey, type);
 
@@ -509,8 +627,7 @@ namespace data
 		Keys keys;		
 		auto& rnd = i2p::context.GetRandomNumberGenerator ();
 		// encryption
-		CryptoPP::DH dh (i2p::crypto::elgp, i2p::crypto::elgg);
-		dh.GenerateKeyPair(rnd, keys.privateKey, keys.publicKey);
+		i2p::crypto::GenerateElGamalKeyPair (rnd, keys.privateKey, keys.publicKey);
 		// signing
 		i2p::crypto::CreateDSARandomKeys (rnd, keys.signingPrivateKey, keys.signingKey);	
 		return keys;
@@ -4,6 +4,8 @@
 #include <inttypes.h>
 #include <string.h>
 #include <string>
+#include <memory>
+#include <functional>
 #include "base64.h"
 #include "ElGamal.h"
 #include "Signature.h"
@@ -145,21 +147,37 @@ namespace data
 			bool Verify (const uint8_t * buf, size_t len, const uint8_t * signature) const;
 			SigningKeyType GetSigningKeyType () const;
 			CryptoKeyType GetCryptoKeyType () const;
-			void DropVerifier (); // to save memory			
+			void DropVerifier (); // releases reference, verifier stays in cache			
 
 		private:
 
 			void CreateVerifier () const;
+			i2p::crypto::Verifier * NewVerifier () const;
 			
 		private:
 
 			Identity m_StandardIdentity;
 			IdentHash m_IdentHash;
-			mutable i2p::crypto::Verifier * m_Verifier; 
+			mutable std::shared_ptr<const i2p::crypto::Verifier> m_Verifier; // from verifiers cache
 			size_t m_ExtendedLen;
 			uint8_t * m_ExtendedBuffer;
 	};	
 	
+	const size_t VERIFIERS_CACHE_SIZE = 1024; // signing keys
+	const int VERIFIER_PRECOMPUTATION_THRESHOLD = 8; // uses before verifier gets replaced by precomputed one
+
+	struct VerifiersCacheStats
+	{
+		size_t size, numPrecomputed;
+		size_t hits, misses;
+		size_t memoryUsage; // approximate
+	};	
+
+	// LRU cache shared by all identities, keyed by signing key type and signing key
+	std::shared_ptr<const i2p::crypto::Verifier> GetCachedVerifier (const std::string& key, 
+		std::function<i2p::crypto::Verifier * ()> create);
+	VerifiersCacheStats GetVerifiersCacheStats ();
+
 	class PrivateKeys // for eepsites
 	{
 		public:
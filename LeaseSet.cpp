@@ -12,11 +12,11 @@ namespace i2p
 namespace data
 {
 	
-	LeaseSet::LeaseSet (const uint8_t * buf, int len)
+	LeaseSet::LeaseSet (const uint8_t * buf, int len, bool verifySignature)
 	{
 		memcpy (m_Buffer, buf, len);
 		m_BufferLen = len;
-		ReadFromBuffer ();
+		ReadFromBuffer (verifySignature);
 	}
 
 	LeaseSet::LeaseSet (const i2p::tunnel::TunnelPool& pool)
@@ -51,15 +51,15 @@ namespace data
 		ReadFromBuffer ();
 	}
 
-	void LeaseSet::Update (const uint8_t * buf, int len)
+	void LeaseSet::Update (const uint8_t * buf, int len, bool verifySignature)
 	{	
 		m_Leases.clear ();
 		memcpy (m_Buffer, buf, len);
 		m_BufferLen = len;
-		ReadFromBuffer ();
+		ReadFromBuffer (verifySignature);
 	}
 	
-	void LeaseSet::ReadFromBuffer ()	
+	void LeaseSet::ReadFromBuffer (bool verifySignature)	
 	{	
 		size_t size = m_Identity.FromBuffer (m_Buffer, m_BufferLen);
 		memcpy (m_EncryptionKey, m_Buffer + size, 256);
@@ -89,9 +89,23 @@ namespace data
 		}	
 		
 		// verify
-		if (!m_Identity.Verify (m_Buffer, leases - m_Buffer, leases))
+		if (verifySignature && !m_Identity.Verify (m_Buffer, leases - m_Buffer, leases))
 			LogPrint ("LeaseSet verification failed");
 	}				
+
+	bool LeaseSet::VerifySignature (const uint8_t * buf, size_t len)
+	{
+		if (len > (size_t)MAX_LS_BUFFER_SIZE) return false;
+		IdentityEx identity;
+		size_t size = identity.FromBuffer (buf, len);
+		if (!size) return false;
+		size += 256; // encryption key
+		size += identity.GetSigningPublicKeyLen (); // unused signing key
+		if (size >= len) return false;
+		size += 1 + buf[size]*sizeof (Lease); // num and leases
+		if (size + identity.GetSignatureLen () > len) return false;
+		return identity.Verify (buf, size, buf + size);
+	}	
 	
 	const std::vector<Lease> LeaseSet::GetNonExpiredLeases () const
 	{
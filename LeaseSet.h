@@ -41,11 +41,11 @@ namespace data
 	{
 		public:
 
-			LeaseSet (const uint8_t * buf, int len);
+			LeaseSet (const uint8_t * buf, int len, bool verifySignature = true);
 			LeaseSet (const LeaseSet& ) = default;
 			LeaseSet (const i2p::tunnel::TunnelPool& pool);
 			LeaseSet& operator=(const LeaseSet& ) = default;
-			void Update (const uint8_t * buf, int len);
+			void Update (const uint8_t * buf, int len, bool verifySignature = true);
 			const IdentityEx& GetIdentity () const { return m_Identity; };			
 
 			const uint8_t * GetBuffer () const { return m_Buffer; };
@@ -60,9 +60,11 @@ namespace data
 			const uint8_t * GetEncryptionPublicKey () const { return m_EncryptionKey; };
 			bool IsDestination () const { return true; };
 
+			static bool VerifySignature (const uint8_t * buf, size_t len); // thread safe, doesn't create LeaseSet
+
 		private:
 
-			void ReadFromBuffer ();
+			void ReadFromBuffer (bool verifySignature = true);
 			
 		private:
 
@@ -22,8 +22,9 @@ struct LogMsg
 	std::stringstream s;
 	std::ostream& output;	
 	LogLevel level;
+	LogMsg * next; // in queue
 
-	LogMsg (std::ostream& o = std::cout, LogLevel l = eLogInfo): output (o), level (l) {};
+	LogMsg (std::ostream& o = std::cout, LogLevel l = eLogInfo): output (o), level (l), next (nullptr) {};
 	
 	void Process();
 };
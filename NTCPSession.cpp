@@ -21,7 +21,7 @@ namespace transport
 	NTCPSession::NTCPSession (boost::asio::io_service& service, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter): 
 		TransportSession (in_RemoteRouter),	m_Socket (service), 
 		m_TerminationTimer (service), m_IsEstablished (false), m_ReceiveBufferOffset (0), 
-		m_NextMessage (nullptr), m_NumSentBytes (0), m_NumReceivedBytes (0)
+		m_NextMessage (nullptr), m_NextFrameOffset (0), m_NextFrameSize (0), m_IsSending (false), m_NumSentBytes (0), m_NumReceivedBytes (0)
 	{		
 		m_DHKeysPair = transports.GetNextDHKeysPair ();
 		m_Establisher = new Establisher;
@@ -35,6 +35,10 @@ namespace transport
 		for (auto it :m_DelayedMessages)
 			i2p::DeleteI2NPMessage (it);
 		m_DelayedMessages.clear ();	
+		for (auto it: m_SendQueue)
+			if (it) i2p::DeleteI2NPMessage (it);
+		for (auto it: m_SendingMessages)
+			if (it) i2p::DeleteI2NPMessage (it);
 	}
 
 	void NTCPSession::CreateAESKey (uint8_t * pubKey, i2p::crypto::AESKey& key)
@@ -348,6 +352,12 @@ namespace transport
 			{
 				// we need more bytes for Phase3
 				expectedSize += paddingLen;	
+				if (NTCP_DEFAULT_PHASE3_SIZE + expectedSize > NTCP_RECEIVE_BUFFER_SIZE)
+				{
+					LogPrint (eLogError, "Phase 3 size ", expectedSize, " exceeds buffer");
+					Terminate ();
+					return;
+				}	
 				LogPrint (eLogDebug, "Wait for ", expectedSize, " more bytes for Phase3");
 				boost::asio::async_read (m_Socket, boost::asio::buffer(m_ReceiveBuffer + NTCP_DEFAULT_PHASE3_SIZE, expectedSize), boost::asio::transfer_all (),                   
 				std::bind(&NTCPSession::HandlePhase3ExtraReceived, shared_from_this (), 
@@ -432,7 +442,6 @@ namespace transport
 
 			Connected ();
 			m_ReceiveBufferOffset = 0;
-			m_NextMessage = nullptr;
 			Receive ();
 		}	
 	}	
@@ -472,14 +481,13 @@ namespace transport
 			Connected ();
 						
 			m_ReceiveBufferOffset = 0;
-			m_NextMessage = nullptr;
 			Receive ();
 		}
 	}
 
 	void NTCPSession::Receive ()
 	{
-		m_Socket.async_read_some (boost::asio::buffer(m_ReceiveBuffer + m_ReceiveBufferOffset, NTCP_BUFFER_SIZE - m_ReceiveBufferOffset),                
+		m_Socket.async_read_some (boost::asio::buffer(m_ReceiveBuffer + m_ReceiveBufferOffset, NTCP_RECEIVE_BUFFER_SIZE - m_ReceiveBufferOffset),                
 			std::bind(&NTCPSession::HandleReceived, shared_from_this (), 
 			std::placeholders::_1, std::placeholders::_2));
 	}	
@@ -496,77 +504,129 @@ namespace transport
 		{
 			m_NumReceivedBytes += bytes_transferred;
 			m_ReceiveBufferOffset += bytes_transferred;
-
-			if (m_ReceiveBufferOffset >= 16)
-			{	
-				uint8_t * nextBlock = m_ReceiveBuffer;
-				while (m_ReceiveBufferOffset >= 16)
-				{
-					if (!DecryptNextBlock (nextBlock)) // 16 bytes
-					{
-						Terminate ();
-						return; 
-					}	
-					nextBlock += 16;
-					m_ReceiveBufferOffset -= 16;
-				}	
-				if (m_ReceiveBufferOffset > 0)
-					memcpy (m_ReceiveBuffer, nextBlock, m_ReceiveBufferOffset);
+			if (!HandleReceivedBlocks ())
+			{
+				Terminate ();
+				return; 
 			}	
-			
 			ScheduleTermination (); // reset termination timer
 			Receive ();
 		}	
 	}	
 
-	bool NTCPSession::DecryptNextBlock (const uint8_t * encrypted) // 16 bytes
+	bool NTCPSession::HandleReceivedBlocks ()
 	{
-		if (!m_NextMessage) // new message, header expected
-		{	
-			m_NextMessage = i2p::NewI2NPMessage ();
-			m_NextMessageOffset = 0;
-			
-			m_Decryption.Decrypt (encrypted, m_NextMessage->buf);
-			uint16_t dataSize = be16toh (*(uint16_t *)m_NextMessage->buf);
-			if (dataSize)
+		// complete blocks are decrypted right into buffer of the message, no copy of data
+		size_t offset = 0;
+		while (offset + 16 <= m_ReceiveBufferOffset)
+		{
+			if (!m_NextMessage)
 			{
-				// new message
+				// first block of frame tells its size
+				uint8_t block[16];
+				m_Decryption.Decrypt (m_ReceiveBuffer + offset, block);
+				offset += 16;
+				uint16_t dataSize = be16toh (*(uint16_t *)block);
+				if (!dataSize)
+				{
+					// timestamp
+					LogPrint ("Timestamp");	
+					continue;
+				}	
 				if (dataSize > NTCP_MAX_MESSAGE_SIZE)
 				{
 					LogPrint (eLogError, "NTCP data size ", dataSize, " exceeds max size");
-					i2p::DeleteI2NPMessage (m_NextMessage);
-					m_NextMessage = nullptr;
 					return false;
 				}
-				m_NextMessageOffset += 16;
-				m_NextMessage->offset = 2; // size field
-				m_NextMessage->len = dataSize + 2; 
-			}	
-			else
-			{	
-				// timestamp
-				LogPrint ("Timestamp");	
-				i2p::DeleteI2NPMessage (m_NextMessage);
-				m_NextMessage = nullptr;
-				return true;
+				// pick buffer of appropriate size, it should fit whole frame if message is sent over NTCP again
+				if (IsNTCPFrameFitting (I2NP_TUNNEL_MESSAGE_HEADROOM, dataSize, I2NP_MAX_TUNNEL_MESSAGE_SIZE))
+					m_NextMessage = i2p::NewI2NPTunnelMessage ();
+				else if (IsNTCPFrameFitting (I2NP_HEADROOM, dataSize, I2NP_MAX_SHORT_MESSAGE_SIZE))
+					m_NextMessage = i2p::NewI2NPShortMessage ();
+				else
+					m_NextMessage = i2p::NewI2NPMessage ();
+				m_NextMessage->len = m_NextMessage->offset + dataSize;
+				m_NextFrameSize = (dataSize + 6 + 0x0F) & ~0x0F; // size, data and checksum, padded
+				// frame is placed from size field, right before I2NP header
+				memcpy (m_NextMessage->GetBuffer () - 2, block, 16);
+				m_NextFrameOffset = 16;
+			}
+			// rest of frame, as many blocks as received, at once
+			size_t len = m_NextFrameSize - m_NextFrameOffset;
+			size_t available = (m_ReceiveBufferOffset - offset) & ~0x0F;
+			if (len > available) len = available;
+			if (len > 0)
+			{
+				m_Decryption.Decrypt (m_ReceiveBuffer + offset, len, m_NextMessage->GetBuffer () - 2 + m_NextFrameOffset);
+				offset += len;
+				m_NextFrameOffset += len;
 			}	
-		}	
-		else // message continues
-		{	
-			m_Decryption.Decrypt (encrypted, m_NextMessage->buf + m_NextMessageOffset);
-			m_NextMessageOffset += 16;
-		}		
-		
-		if (m_NextMessageOffset >= m_NextMessage->len + 4) // +checksum
-		{	
-			// we have a complete I2NP message
+			if (m_NextFrameOffset < m_NextFrameSize) break; // not received completely yet
 			i2p::HandleI2NPMessage (m_NextMessage);	
 			m_NextMessage = nullptr;
-		}
-		return true;	
- 	}	
+		}	
+		if (offset > 0)
+		{
+			// keep incomplete block at the beginning
+			m_ReceiveBufferOffset -= offset;
+			if (m_ReceiveBufferOffset > 0)
+				memmove (m_ReceiveBuffer, m_ReceiveBuffer + offset, m_ReceiveBufferOffset);
+		}	
+		return true;
+	}	
 
 	void NTCPSession::Send (i2p::I2NPMessage * msg)
+	{
+		if (msg && msg->offset < 2)
+		{
+			LogPrint (eLogError, "Malformed I2NP message");
+			i2p::DeleteI2NPMessage (msg);
+			return;
+		}	
+		if (msg && !IsNTCPFrameFitting (msg->offset, msg->GetLength (), msg->maxLen))
+		{
+			// no room for size, padding or checksum, move to buffer where frame fits
+			auto copy = i2p::NewI2NPMessage ();
+			*copy = *msg;
+			i2p::DeleteI2NPMessage (msg);
+			msg = copy;
+		}	
+		m_SendQueue.push_back (msg);
+		if (!m_IsSending)
+			SendQueuedMessages ();
+	}
+
+	void NTCPSession::SendQueuedMessages ()
+	{
+		// encrypt in place and write everything queued since last write with single gather write
+		std::vector<boost::asio::const_buffer> buffers;
+		size_t batchSize = 0, numMessages = 0;
+		bool hasTimestamp = false;
+		for (auto msg: m_SendQueue)
+		{
+			if (numMessages >= NTCP_MAX_OUTGOING_BATCH_NUM_MESSAGES || 
+				(numMessages > 0 && batchSize + (msg ? msg->GetLength () : 0) > NTCP_MAX_OUTGOING_BATCH_SIZE))
+				break;
+			if (!msg)
+			{
+				// timestamps share m_TimeSyncBuffer, next one goes with next batch
+				if (hasTimestamp) break;
+				hasTimestamp = true;
+			}	
+			const uint8_t * encrypted;
+			size_t len = EncryptMessage (msg, encrypted);
+			buffers.push_back (boost::asio::buffer (encrypted, len));
+			batchSize += len;
+			numMessages++;
+		}
+		m_SendingMessages.assign (m_SendQueue.begin (), m_SendQueue.begin () + numMessages);
+		m_SendQueue.erase (m_SendQueue.begin (), m_SendQueue.begin () + numMessages);
+		m_IsSending = true;
+		boost::asio::async_write (m_Socket, buffers, boost::asio::transfer_all (),                      
+        	std::bind(&NTCPSession::HandleSent, shared_from_this (), std::placeholders::_1, std::placeholders::_2));	
+	}
+
+	size_t NTCPSession::EncryptMessage (i2p::I2NPMessage * msg, const uint8_t *& encrypted)
 	{
 		uint8_t * sendBuffer;
 		int len;
@@ -574,11 +634,7 @@ namespace transport
 		if (msg)
 		{	
 			// regular I2NP
-			if (msg->offset < 2)
-			{
-				LogPrint (eLogError, "Malformed I2NP message");
-				i2p::DeleteI2NPMessage (msg);
-			}	
+			msg->UpdateChks (); // lazy, not needed for SSU
 			sendBuffer = msg->GetBuffer () - 2; 
 			len = msg->GetLength ();
 			*((uint16_t *)sendBuffer) = htobe16 (len);
@@ -599,15 +655,16 @@ namespace transport
 
 		int l = len + padding + 6;
 		m_Encryption.Encrypt(sendBuffer, l, sendBuffer);	
-
-		boost::asio::async_write (m_Socket, boost::asio::buffer (sendBuffer, l), boost::asio::transfer_all (),                      
-        	std::bind(&NTCPSession::HandleSent, shared_from_this (), std::placeholders::_1, std::placeholders::_2, msg));	
+		encrypted = sendBuffer;
+		return l;
 	}
 		
-	void NTCPSession::HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred, i2p::I2NPMessage * msg)
+	void NTCPSession::HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred)
 	{		
-		if (msg)
-			i2p::DeleteI2NPMessage (msg);
+		for (auto it: m_SendingMessages)
+			if (it) i2p::DeleteI2NPMessage (it);
+		m_SendingMessages.clear ();
+		m_IsSending = false;
 		if (ecode)
         {
 			LogPrint (eLogWarning, "Couldn't send msg: ", ecode.message ());
@@ -619,6 +676,8 @@ namespace transport
 		{	
 			m_NumSentBytes += bytes_transferred;
 			ScheduleTermination (); // reset termination timer
+			if (!m_SendQueue.empty ())
+				SendQueuedMessages (); // socket is writable again
 		}	
 	}
 
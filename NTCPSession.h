@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <list>
+#include <vector>
 #include <memory>
 #include <cryptopp/modes.h>
 #include <cryptopp/aes.h>
@@ -39,7 +40,11 @@ namespace transport
 #pragma pack()	
 
 	const size_t NTCP_MAX_MESSAGE_SIZE = 16384; 
-	const size_t NTCP_BUFFER_SIZE = 1040; // fits one tunnel message (1028)
+	const size_t NTCP_BUFFER_SIZE = 1040; // upper bound for our identity in phase 3
+	const size_t NTCP_MAX_FRAME_SIZE = (NTCP_MAX_MESSAGE_SIZE + 6 + 0x0F) & ~0x0F; // size, data and checksum, padded 
+	const size_t NTCP_RECEIVE_BUFFER_SIZE = NTCP_MAX_FRAME_SIZE; // frames are decrypted out of it, one read brings up to max frame
+	const size_t NTCP_MAX_OUTGOING_BATCH_SIZE = 32768; // bytes per write
+	const size_t NTCP_MAX_OUTGOING_BATCH_NUM_MESSAGES = 64; // scatter/gather buffers per write
 	const int NTCP_TERMINATION_TIMEOUT = 120; // 2 minutes
 	const size_t NTCP_DEFAULT_PHASE3_SIZE = 2/*size*/ + i2p::data::DEFAULT_IDENTITY_SIZE/*387*/ + 4/*ts*/ + 15/*padding*/ + 40/*signature*/; // 448 	
 
@@ -91,10 +96,12 @@ namespace transport
 			// common
 			void Receive ();
 			void HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred);
-			bool DecryptNextBlock (const uint8_t * encrypted);	
+			bool HandleReceivedBlocks ();
 		
-			void Send (i2p::I2NPMessage * msg);
-			void HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred, i2p::I2NPMessage * msg);
+			void Send (i2p::I2NPMessage * msg); // nullptr for timestamp
+			void SendQueuedMessages ();
+			size_t EncryptMessage (i2p::I2NPMessage * msg, const uint8_t *& encrypted); // returns encrypted length
+			void HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred);
 
 
 			// timer
@@ -117,13 +124,17 @@ namespace transport
 				NTCPPhase2 phase2;
 			} * m_Establisher;	
 			
-			i2p::crypto::AESAlignedBuffer<NTCP_BUFFER_SIZE + 16> m_ReceiveBuffer;
+			i2p::crypto::AESAlignedBuffer<NTCP_RECEIVE_BUFFER_SIZE> m_ReceiveBuffer;
 			i2p::crypto::AESAlignedBuffer<16> m_TimeSyncBuffer;
-			int m_ReceiveBufferOffset; 
+			size_t m_ReceiveBufferOffset; // incomplete block is kept
+			i2p::I2NPMessage * m_NextMessage; // frame being received
+			size_t m_NextFrameOffset, m_NextFrameSize;
 
-			i2p::I2NPMessage * m_NextMessage;
 			std::list<i2p::I2NPMessage *> m_DelayedMessages;
-			size_t m_NextMessageOffset;
+
+			// one write at the time, messages queued meanwhile go with the next one 
+			bool m_IsSending;
+			std::vector<i2p::I2NPMessage *> m_SendQueue, m_SendingMessages;
 
 			size_t m_NumSentBytes, m_NumReceivedBytes;
 	};	
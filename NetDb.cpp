@@ -12,6 +12,7 @@
 #include "RouterContext.h"
 #include "Garlic.h"
 #include "NetDb.h"
+#include "Profiling.h"
 #include "Reseed.h"
 #include "util.h"
 
@@ -78,6 +79,7 @@ namespace data
 	void NetDb::Start ()
 	{	
 		Load (m_NetDbPath);
+		profiles.Load ();
 		// try SU3 first
 		int reseedRetries = 0;
 		while (m_RouterInfos.size () < 100 && reseedRetries < 10)
@@ -96,6 +98,7 @@ namespace data
 			reseedRetries++;
 			Load (m_NetDbPath);
 		}	
+		m_Verifier.Start ();
 		m_Thread = new std::thread (std::bind (&NetDb::Run, this));
 	}
 	
@@ -109,20 +112,24 @@ namespace data
 			delete m_Thread;
 			m_Thread = 0;
 		}	
+		m_Verifier.Stop ();
+		profiles.Save ();
 	}	
 	
 	void NetDb::Run ()
 	{
-		uint32_t lastSave = 0, lastPublish = 0;
+		uint32_t lastSave = 0, lastPublish = 0, lastBadRoutersUpdate = 0;
+		std::vector<I2NPMessage *> msgs;
 		m_IsRunning = true;
 		while (m_IsRunning)
 		{	
 			try
 			{	
-				I2NPMessage * msg = m_Queue.GetNextWithTimeout (15000); // 15 sec
-				if (msg)
+				msgs.clear ();
+				m_Queue.GetAllWithTimeout (msgs, 15000); // 15 sec
+				if (!msgs.empty ())
 				{	
-					while (msg)
+					for (auto msg: msgs)
 					{
 						switch (msg->GetHeader ()->typeID) 
 						{
@@ -142,7 +149,6 @@ namespace data
 								LogPrint ("NetDb: unexpected message type ", msg->GetHeader ()->typeID);
 								i2p::HandleI2NPMessage (msg);
 						}	
-						msg = m_Queue.Get ();
 					}	
 				}
 				else 				
@@ -159,10 +165,16 @@ namespace data
 					if (lastSave)
 					{
 						SaveUpdated (m_NetDbPath);
+						profiles.Save ();
 						ManageLeaseSets ();
 					}	
 					lastSave = ts;
 				}	
+				if (ts - lastBadRoutersUpdate >= PEER_PROFILE_BAD_ROUTERS_UPDATE_INTERVAL)
+				{
+					profiles.UpdateBadRouters ();
+					lastBadRoutersUpdate = ts;
+				}	
 				if (ts - lastPublish >= 600) // publish every 10 minutes
 				{
 					Publish ();
@@ -183,21 +195,21 @@ namespace data
 			AddRouterInfo (identity.GetIdentHash (), buf, len);	
 	}
 
-	void NetDb::AddRouterInfo (const IdentHash& ident, const uint8_t * buf, int len)
+	void NetDb::AddRouterInfo (const IdentHash& ident, const uint8_t * buf, int len, bool verifySignature)
 	{	
 		DeleteRequestedDestination (ident);	
 		auto r = FindRouter (ident);
 		if (r)
 		{
 			auto ts = r->GetTimestamp ();
-			r->Update (buf, len);
+			r->Update (buf, len, verifySignature);
 			if (r->GetTimestamp () > ts)
 				LogPrint ("RouterInfo updated");
 		}	
 		else	
 		{	
 			LogPrint ("New RouterInfo added");
-			auto newRouter = std::make_shared<RouterInfo> (buf, len);
+			auto newRouter = std::make_shared<RouterInfo> (buf, len, verifySignature);
 			{
 				std::unique_lock<std::mutex> l(m_RouterInfosMutex);
 				m_RouterInfos[newRouter->GetIdentHash ()] = newRouter;
@@ -211,7 +223,7 @@ namespace data
 	}	
 
 	void NetDb::AddLeaseSet (const IdentHash& ident, const uint8_t * buf, int len,
-		i2p::tunnel::InboundTunnel * from)
+		i2p::tunnel::InboundTunnel * from, bool verifySignature)
 	{
 		DeleteRequestedDestination (ident);
 		if (!from) // unsolicited LS must be received directly
@@ -219,13 +231,13 @@ namespace data
 			auto it = m_LeaseSets.find(ident);
 			if (it != m_LeaseSets.end ())
 			{
-				it->second->Update (buf, len); 
+				it->second->Update (buf, len, verifySignature); 
 				LogPrint ("LeaseSet updated");
 			}
 			else
 			{	
 				LogPrint ("New LeaseSet added");
-				m_LeaseSets[ident] = new LeaseSet (buf, len);
+				m_LeaseSets[ident] = new LeaseSet (buf, len, verifySignature);
 			}	
 		}	
 	}	
@@ -453,36 +465,158 @@ namespace data
 	
 	void NetDb::HandleDatabaseStoreMsg (I2NPMessage * m)
 	{	
+		NetDbStore * store = m_Verifier.GetCompleted (m);
+		if (!store)
+		{
+			if (m_Verifier.Submit (m)) return; // will be posted back after verification
+			store = NetDbVerifier::Verify (m); // too many pending, verify here
+		}	
+		// only verified entries get to netDb
+		if (store->isVerified)
+		{
+			if (store->isLeaseSet)
+			{
+				LogPrint ("LeaseSet");
+				AddLeaseSet (store->key, store->buffer.data (), store->buffer.size (), m->from, false);
+			}	
+			else
+			{
+				LogPrint ("RouterInfo");
+				AddRouterInfo (store->key, store->buffer.data (), store->buffer.size (), false);
+			}	
+		}	
+		delete store;
+		i2p::DeleteI2NPMessage (m);
+	}	
+
+	void NetDbVerifier::Start ()
+	{
+		m_IsRunning = true;
+		for (int i = 0; i < NETDB_NUM_VERIFICATION_THREADS; i++)
+			m_Threads.push_back (new std::thread (std::bind (&NetDbVerifier::Run, this)));
+	}
+
+	void NetDbVerifier::Stop ()
+	{
+		{
+			std::unique_lock<std::mutex> l(m_Mutex);
+			m_IsRunning = false;
+			m_NonEmpty.notify_all ();
+		}	
+		for (auto it: m_Threads)
+		{
+			it->join ();
+			delete it;
+		}	
+		m_Threads.clear ();
+		while (!m_Queue.empty ())
+		{
+			i2p::DeleteI2NPMessage (m_Queue.front ());
+			m_Queue.pop ();
+		}	
+		for (auto it: m_Completed) // messages themselves are in netdb's queue
+			delete it.second;
+		m_Completed.clear ();
+	}
+
+	bool NetDbVerifier::Submit (I2NPMessage * msg)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_IsRunning || m_Queue.size () + m_Completed.size () >= NETDB_MAX_PENDING_VERIFICATIONS)
+			return false;
+		m_Queue.push (msg);
+		m_NonEmpty.notify_one ();
+		return true;
+	}	
+
+	NetDbStore * NetDbVerifier::GetCompleted (I2NPMessage * msg)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		auto it = m_Completed.find (msg);
+		if (it == m_Completed.end ()) return nullptr;
+		auto store = it->second;
+		m_Completed.erase (it);
+		return store;
+	}	
+
+	size_t NetDbVerifier::GetNumPending () const
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		return m_Queue.size () + m_Completed.size ();
+	}	
+
+	void NetDbVerifier::Run ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		while (m_IsRunning)
+		{
+			if (m_Queue.empty ())
+			{
+				m_NonEmpty.wait (l);
+				continue;
+			}	
+			auto msg = m_Queue.front ();
+			m_Queue.pop ();
+			l.unlock ();
+			auto store = Verify (msg);
+			l.lock ();
+			m_Completed[msg] = store;
+			l.unlock ();
+			netdb.PostI2NPMsg (msg); // completion is handled by netdb thread
+			l.lock ();
+		}	
+	}	
+
+	NetDbStore * NetDbVerifier::Verify (I2NPMessage * m)
+	{
+		NetDbStore * store = new NetDbStore;
+		store->isVerified = false;
 		const uint8_t * buf = m->GetPayload ();
 		size_t len = be16toh (m->GetHeader ()->size);		
 		I2NPDatabaseStoreMsg * msg = (I2NPDatabaseStoreMsg *)buf;
+		store->key = msg->key;
+		store->isLeaseSet = msg->type;
 		size_t offset = sizeof (I2NPDatabaseStoreMsg);
 		if (msg->replyToken)
 			offset += 36;
-		if (msg->type)
-		{
-			LogPrint ("LeaseSet");
-			AddLeaseSet (msg->key, buf + offset, len - offset, m->from);
-		}	
-		else
+		if (offset >= len) return store;
+		try
 		{
-			LogPrint ("RouterInfo");
-			size_t size = be16toh (*(uint16_t *)(buf + offset));
-			if (size > 2048)
+			if (store->isLeaseSet)
 			{
-				LogPrint ("Invalid RouterInfo length ", (int)size);
-				return;
+				store->buffer.assign (buf + offset, buf + len);
+				store->isVerified = LeaseSet::VerifySignature (buf + offset, len - offset);
 			}	
-			offset += 2;
-			CryptoPP::Gunzip decompressor;
-			decompressor.Put (buf + offset, size);
-			decompressor.MessageEnd();
-			uint8_t uncompressed[2048];
-			size_t uncomressedSize = decompressor.MaxRetrievable ();
-			decompressor.Get (uncompressed, uncomressedSize);
-			AddRouterInfo (msg->key, uncompressed, uncomressedSize);
+			else
+			{
+				size_t size = be16toh (*(uint16_t *)(buf + offset));
+				offset += 2;
+				if (size > 2048 || offset + size > len)
+				{
+					LogPrint ("Invalid RouterInfo length ", (int)size);
+					return store;
+				}	
+				CryptoPP::Gunzip decompressor;
+				decompressor.Put (buf + offset, size);
+				decompressor.MessageEnd();
+				size_t uncomressedSize = decompressor.MaxRetrievable ();
+				if (uncomressedSize > (size_t)MAX_RI_BUFFER_SIZE)
+				{
+					LogPrint ("Invalid uncompressed RouterInfo length ", (int)uncomressedSize);
+					return store;
+				}	
+				store->buffer.resize (uncomressedSize);
+				decompressor.Get (store->buffer.data (), uncomressedSize);
+				store->isVerified = RouterInfo::VerifySignature (store->buffer.data (), uncomressedSize);
+			}	
+		}
+		catch (std::exception& ex)
+		{
+			LogPrint ("NetDb: DatabaseStore ", ex.what ());
 		}	
-		i2p::DeleteI2NPMessage (m);
+		if (!store->isVerified)
+			LogPrint (store->isLeaseSet ? "LeaseSet" : "RouterInfo", " signature verification failed");
+		return store;
 	}	
 
 	void NetDb::HandleDatabaseSearchReplyMsg (I2NPMessage * msg)
@@ -829,21 +963,24 @@ namespace data
 	
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
+		auto badRouters = profiles.GetBadRouters (); // once, not for every candidate
 		return GetRandomRouter (
-			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool 
+			[compatibleWith, badRouters](std::shared_ptr<const RouterInfo> router)->bool 
 			{ 
 				return !router->IsHidden () && router != compatibleWith && 
-					router->IsCompatible (*compatibleWith); 
+					router->IsCompatible (*compatibleWith) && !badRouters->count (router->GetIdentHash ()); 
 			});
 	}	
 
 	std::shared_ptr<const RouterInfo> NetDb::GetHighBandwidthRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
+		auto badRouters = profiles.GetBadRouters ();
 		return GetRandomRouter (
-			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool 
+			[compatibleWith, badRouters](std::shared_ptr<const RouterInfo> router)->bool 
 			{ 
 				return !router->IsHidden () && router != compatibleWith &&
-					router->IsCompatible (*compatibleWith) && (router->GetCaps () & RouterInfo::eHighBandwidth); 
+					router->IsCompatible (*compatibleWith) && (router->GetCaps () & RouterInfo::eHighBandwidth) &&
+					!badRouters->count (router->GetIdentHash ()); 
 			});
 	}	
 	
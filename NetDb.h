@@ -5,9 +5,12 @@
 #include <set>
 #include <map>
 #include <list>
+#include <vector>
+#include <queue>
 #include <string>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <boost/filesystem.hpp>
 #include "Queue.h"
 #include "I2NPProtocol.h"
@@ -52,6 +55,45 @@ namespace data
 			uint64_t m_CreationTime;
 	};	
 	
+	const int NETDB_NUM_VERIFICATION_THREADS = 2;
+	const size_t NETDB_MAX_PENDING_VERIFICATIONS = 256; // verified by netdb thread itself if more
+
+	struct NetDbStore // parsed DatabaseStore
+	{
+		IdentHash key;
+		bool isLeaseSet, isVerified;
+		std::vector<uint8_t> buffer; // uncompressed RouterInfo or LeaseSet
+	};	
+
+	class NetDbVerifier
+	{
+		public:
+
+			NetDbVerifier (): m_IsRunning (false) {};
+			~NetDbVerifier () { Stop (); };
+
+			void Start ();
+			void Stop ();
+			bool Submit (I2NPMessage * msg); // msg is posted back to netdb after verification, false if full
+			NetDbStore * GetCompleted (I2NPMessage * msg); // nullptr if msg has not been verified yet 
+			size_t GetNumPending () const;
+
+			static NetDbStore * Verify (I2NPMessage * msg); // in caller's thread
+
+		private:
+
+			void Run ();
+
+		private:
+
+			bool m_IsRunning;
+			std::vector<std::thread *> m_Threads;
+			std::queue<I2NPMessage *> m_Queue;
+			std::map<I2NPMessage *, NetDbStore *> m_Completed;
+			mutable std::mutex m_Mutex;
+			std::condition_variable m_NonEmpty;
+	};	
+	
 	class NetDb
 	{
 		public:
@@ -63,8 +105,9 @@ namespace data
 			void Stop ();
 			
 			void AddRouterInfo (const uint8_t * buf, int len);
-			void AddRouterInfo (const IdentHash& ident, const uint8_t * buf, int len);
-			void AddLeaseSet (const IdentHash& ident, const uint8_t * buf, int len, i2p::tunnel::InboundTunnel * from);
+			void AddRouterInfo (const IdentHash& ident, const uint8_t * buf, int len, bool verifySignature = true);
+			void AddLeaseSet (const IdentHash& ident, const uint8_t * buf, int len, i2p::tunnel::InboundTunnel * from,
+				bool verifySignature = true);
 			std::shared_ptr<RouterInfo> FindRouter (const IdentHash& ident) const;
 			LeaseSet * FindLeaseSet (const IdentHash& destination) const;
 
@@ -87,6 +130,7 @@ namespace data
 			int GetNumRouters () const { return m_RouterInfos.size (); };
 			int GetNumFloodfills () const { return m_Floodfills.size (); };
 			int GetNumLeaseSets () const { return m_LeaseSets.size (); };
+			size_t GetNumPendingVerifications () const { return m_Verifier.GetNumPending (); };
 			
 		private:
 
@@ -118,7 +162,8 @@ namespace data
 			
 			bool m_IsRunning;
 			std::thread * m_Thread;	
-			i2p::util::Queue<I2NPMessage> m_Queue; // of I2NPDatabaseStoreMsg
+			i2p::util::MPSCQueue<I2NPMessage> m_Queue; // of I2NPDatabaseStoreMsg
+			NetDbVerifier m_Verifier;
 
 			static const char m_NetDbPath[];
 	};
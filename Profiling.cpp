@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <fstream>
+#include "base64.h"
+#include "Log.h"
+#include "Timestamp.h"
+#include "util.h"
+#include "RouterContext.h"
+#include "Profiling.h"
+
+namespace i2p
+{
+namespace data
+{
+	RouterProfile::RouterProfile (): m_NumBuildsAccepted (0), m_NumBuildsRejected (0), 
+		m_NumBuildsTimedOut (0), m_NumTestsSucceeded (0), m_NumTestsFailed (0), m_NumConnectFailures (0),
+		m_AverageLatency (0), m_LastUpdateTime (i2p::util::GetSecondsSinceEpoch ()), 
+		m_LastDecayTime (m_LastUpdateTime)
+	{
+	}
+
+	void RouterProfile::Update ()
+	{
+		m_LastUpdateTime = i2p::util::GetSecondsSinceEpoch ();
+		// old events weigh less, peer might have been restarted or reconfigured
+		while (m_LastUpdateTime >= m_LastDecayTime + PEER_PROFILE_DECAY_INTERVAL)
+		{
+			m_NumBuildsAccepted /= 2; m_NumBuildsRejected /= 2; m_NumBuildsTimedOut /= 2;
+			m_NumTestsSucceeded /= 2; m_NumTestsFailed /= 2; m_NumConnectFailures /= 2;
+			m_LastDecayTime += PEER_PROFILE_DECAY_INTERVAL;
+		}
+	}
+
+	void RouterProfile::TunnelBuildResponse (bool accepted)
+	{
+		Update ();
+		if (accepted)
+			m_NumBuildsAccepted++;
+		else
+			m_NumBuildsRejected++;
+	}
+
+	void RouterProfile::TunnelBuildTimeout ()
+	{
+		Update ();
+		m_NumBuildsTimedOut++;
+	}
+
+	void RouterProfile::TunnelTestSucceeded (int latency)
+	{
+		Update ();
+		m_NumTestsSucceeded++;
+		if (m_AverageLatency)
+			m_AverageLatency += (latency - m_AverageLatency)/PEER_PROFILE_LATENCY_EWMA_WEIGHT;
+		else
+			m_AverageLatency = latency;
+		if (m_AverageLatency <= 0) m_AverageLatency = 1; // 0 means unknown
+	}
+
+	void RouterProfile::TunnelTestFailed ()
+	{
+		Update ();
+		m_NumTestsFailed++;
+	}
+
+	void RouterProfile::ConnectFailed ()
+	{
+		Update ();
+		m_NumConnectFailures++;
+	}
+
+	int RouterProfile::GetScore () const
+	{
+		int numEvents = m_NumBuildsAccepted + m_NumBuildsRejected + m_NumBuildsTimedOut + 
+			m_NumTestsSucceeded + m_NumTestsFailed + m_NumConnectFailures;
+		if (!numEvents) return 0;
+		// timeouts and connect failures cost more than explicit rejects
+		int score = 100*((int)(m_NumBuildsAccepted + m_NumTestsSucceeded) - (int)m_NumBuildsRejected - 
+			(int)m_NumTestsFailed - 2*(int)(m_NumBuildsTimedOut + m_NumConnectFailures))/numEvents;
+		if (m_AverageLatency)
+			score -= m_AverageLatency < 5000 ? m_AverageLatency/100 : 50; // up to 50 for 5 seconds round trip
+		if (score < -100) score = -100;
+		return score;
+	}
+
+	bool RouterProfile::IsBad () const
+	{
+		int numEvents = m_NumBuildsAccepted + m_NumBuildsRejected + m_NumBuildsTimedOut + 
+			m_NumTestsSucceeded + m_NumTestsFailed + m_NumConnectFailures;
+		return numEvents >= PEER_PROFILE_MIN_NUM_EVENTS && GetScore () < PEER_PROFILE_BAD_SCORE;
+	}
+
+	std::string RouterProfile::ToString () const
+	{
+		char s[256];
+		snprintf (s, sizeof (s), "%u %u %u %u %u %u %d %llu %llu", m_NumBuildsAccepted, m_NumBuildsRejected, 
+			m_NumBuildsTimedOut, m_NumTestsSucceeded, m_NumTestsFailed, m_NumConnectFailures, m_AverageLatency, 
+			(unsigned long long)m_LastUpdateTime, (unsigned long long)m_LastDecayTime);
+		return s;
+	}
+
+	bool RouterProfile::FromString (const std::string& s)
+	{
+		unsigned long long lastUpdateTime, lastDecayTime;
+		if (sscanf (s.c_str (), "%u %u %u %u %u %u %d %llu %llu", &m_NumBuildsAccepted, &m_NumBuildsRejected, 
+			&m_NumBuildsTimedOut, &m_NumTestsSucceeded, &m_NumTestsFailed, &m_NumConnectFailures, &m_AverageLatency, 
+			&lastUpdateTime, &lastDecayTime) != 9) 
+			return false;
+		m_LastUpdateTime = lastUpdateTime;
+		m_LastDecayTime = lastDecayTime;
+		Update (); // apply decay for the time we were down
+		m_LastUpdateTime = lastUpdateTime; // expiration counts from last real event
+		return true;
+	}
+
+	Profiles profiles;
+
+	Profiles::Profiles (): m_BadRouters (std::make_shared<std::set<IdentHash> > ())
+	{
+	}
+
+	void Profiles::Load ()
+	{
+		std::ifstream f (i2p::util::filesystem::GetFullPath (PEER_PROFILES_FILENAME).c_str (), std::ifstream::in); // in text mode
+		if (!f.is_open ()) return;
+		uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+		int numProfiles = 0;
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		std::string s;
+		while (std::getline (f, s))
+		{
+			// ident in base64, space, counters
+			size_t pos = s.find (' ');
+			if (pos == std::string::npos) continue;
+			IdentHash ident;
+			if (Base64ToByteStream (s.c_str (), pos, ident, 32) != 32) continue;
+			RouterProfile profile;
+			if (profile.FromString (s.substr (pos + 1)) && 
+				ts < profile.GetLastUpdateTime () + PEER_PROFILE_EXPIRATION_TIMEOUT)
+			{
+				m_Profiles[ident] = profile;
+				numProfiles++;
+			}
+		}
+		l.unlock ();
+		LogPrint (numProfiles, " peer profiles loaded");
+		UpdateBadRouters ();
+	}
+
+	void Profiles::Save ()
+	{
+		std::string path = i2p::util::filesystem::GetFullPath (PEER_PROFILES_FILENAME);
+		std::ofstream f ((path + ".tmp").c_str (), std::ofstream::out); // in text mode
+		if (!f.is_open ())
+		{
+			LogPrint ("Can't save peer profiles to ", path);
+			return;
+		}
+		uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+		std::map<IdentHash, RouterProfile> profilesCopy; // file is written without mutex
+		{
+			std::unique_lock<std::mutex> l(m_ProfilesMutex);
+			for (auto it = m_Profiles.begin (); it != m_Profiles.end ();)
+			{
+				if (ts < it->second.GetLastUpdateTime () + PEER_PROFILE_EXPIRATION_TIMEOUT)
+				{
+					profilesCopy.insert (*it);
+					it++;
+				}
+				else
+					it = m_Profiles.erase (it);
+			}
+		}
+		for (auto& it: profilesCopy)
+			f << it.first.ToBase64 () << " " << it.second.ToString () << std::endl;
+		f.close ();
+		// replace old file only if completely written
+		if (f.fail () || rename ((path + ".tmp").c_str (), path.c_str ()))
+			LogPrint ("Can't save peer profiles to ", path);
+	}
+
+	RouterProfile * Profiles::GetProfile (const IdentHash& ident)
+	{
+		if (ident == i2p::context.GetIdentHash ()) return nullptr; // zero hop tunnels
+		return &m_Profiles[ident];
+	}
+
+	void Profiles::TunnelBuildResponse (const IdentHash& ident, bool accepted)
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		auto profile = GetProfile (ident);
+		if (profile) profile->TunnelBuildResponse (accepted);
+	}
+
+	void Profiles::TunnelBuildTimeout (const IdentHash& ident)
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		auto profile = GetProfile (ident);
+		if (profile) profile->TunnelBuildTimeout ();
+	}
+
+	void Profiles::TunnelTestSucceeded (const IdentHash& ident, int latency)
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		auto profile = GetProfile (ident);
+		if (profile) profile->TunnelTestSucceeded (latency);
+	}
+
+	void Profiles::TunnelTestFailed (const IdentHash& ident)
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		auto profile = GetProfile (ident);
+		if (profile) profile->TunnelTestFailed ();
+	}
+
+	void Profiles::ConnectFailed (const IdentHash& ident)
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		auto profile = GetProfile (ident);
+		if (profile) profile->ConnectFailed ();
+	}
+
+	int Profiles::GetScore (const IdentHash& ident) const
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		auto it = m_Profiles.find (ident);
+		return it != m_Profiles.end () ? it->second.GetScore () : 0;
+	}
+
+	bool Profiles::IsBad (const IdentHash& ident) const
+	{
+		return GetBadRouters ()->count (ident) > 0;
+	}
+
+	std::shared_ptr<const std::set<IdentHash> > Profiles::GetBadRouters () const
+	{
+		std::unique_lock<std::mutex> l(m_BadRoutersMutex);
+		return m_BadRouters;
+	}
+
+	void Profiles::UpdateBadRouters ()
+	{
+		auto badRouters = std::make_shared<std::set<IdentHash> > ();
+		{
+			std::unique_lock<std::mutex> l(m_ProfilesMutex);
+			for (auto& it: m_Profiles)
+				if (it.second.IsBad ())
+					badRouters->insert (it.first);
+		}
+		std::unique_lock<std::mutex> l(m_BadRoutersMutex);
+		m_BadRouters = badRouters;
+	}
+
+	size_t Profiles::GetNumProfiles () const
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		return m_Profiles.size ();
+	}
+}
+}
@@ -0,0 +1,95 @@
+#ifndef PROFILING_H__
+#define PROFILING_H__
+
+#include <inttypes.h>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Identity.h"
+
+namespace i2p
+{
+namespace data
+{
+	const char PEER_PROFILES_FILENAME[] = "peerProfiles.txt";
+	const int PEER_PROFILE_DECAY_INTERVAL = 3600; // in seconds, counters are halved
+	const int PEER_PROFILE_EXPIRATION_TIMEOUT = 72*3600; // in seconds, not updated profiles are dropped
+	const int PEER_PROFILE_MIN_NUM_EVENTS = 5; // before peer can be considered bad
+	const int PEER_PROFILE_BAD_SCORE = -50;
+	const int PEER_PROFILE_LATENCY_EWMA_WEIGHT = 8; // new sample contributes 1/8
+	const int PEER_PROFILE_BAD_ROUTERS_UPDATE_INTERVAL = 15; // in seconds, by netdb
+
+	class RouterProfile
+	{
+		public:
+
+			RouterProfile ();
+
+			void TunnelBuildResponse (bool accepted);
+			void TunnelBuildTimeout ();
+			void TunnelTestSucceeded (int latency); // in milliseconds
+			void TunnelTestFailed ();
+			void ConnectFailed ();
+
+			int GetScore () const; // from -100 (always fails) to 100, 0 if unknown
+			bool IsBad () const;
+			int GetAverageLatency () const { return m_AverageLatency; }; // 0 if unknown
+			uint64_t GetLastUpdateTime () const { return m_LastUpdateTime; };
+
+			std::string ToString () const;
+			bool FromString (const std::string& s);
+
+		private:
+
+			void Update ();
+
+		private:
+
+			uint32_t m_NumBuildsAccepted, m_NumBuildsRejected, m_NumBuildsTimedOut;
+			uint32_t m_NumTestsSucceeded, m_NumTestsFailed, m_NumConnectFailures;
+			int m_AverageLatency; // EWMA of tunnel tests round trips through this peer
+			uint64_t m_LastUpdateTime, m_LastDecayTime; // in seconds
+	};
+
+	class Profiles // thread safe
+	{
+		public:
+
+			Profiles ();
+			void Load ();
+			void Save ();
+
+			// hops of our tunnels and remote routers of transports
+			void TunnelBuildResponse (const IdentHash& ident, bool accepted);
+			void TunnelBuildTimeout (const IdentHash& ident);
+			void TunnelTestSucceeded (const IdentHash& ident, int latency);
+			void TunnelTestFailed (const IdentHash& ident);
+			void ConnectFailed (const IdentHash& ident);
+
+			int GetScore (const IdentHash& ident) const;
+			bool IsBad (const IdentHash& ident) const; // from snapshot
+			size_t GetNumProfiles () const;
+
+			// take snapshot once for checking many routers, never null 
+			std::shared_ptr<const std::set<IdentHash> > GetBadRouters () const;
+			void UpdateBadRouters (); // snapshot, called by netdb periodically
+
+		private:
+
+			RouterProfile * GetProfile (const IdentHash& ident); // creates new if not found, called under mutex
+
+		private:
+
+			mutable std::mutex m_ProfilesMutex;
+			std::map<IdentHash, RouterProfile> m_Profiles;
+			mutable std::mutex m_BadRoutersMutex; // for pointer only, set is immutable
+			std::shared_ptr<const std::set<IdentHash> > m_BadRouters;
+	};
+
+	extern Profiles profiles;
+}
+}
+
+#endif
@@ -2,6 +2,9 @@
 #define QUEUE_H__
 
 #include <queue>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
@@ -23,6 +26,28 @@ namespace util
 				m_NonEmpty.notify_one ();
 			}
 
+			void PutMany (const std::vector<Element *>& elements)
+			{
+				std::unique_lock<std::mutex>  l(m_QueueMutex);
+				for (auto it: elements)
+					m_Queue.push (it);	
+				m_NonEmpty.notify_one ();
+			}
+
+			void GetAll (std::vector<Element *>& elements) // appends, doesn't wait
+			{
+				std::queue<Element *> queue;
+				{
+					std::unique_lock<std::mutex> l(m_QueueMutex);
+					m_Queue.swap (queue);
+				}	
+				while (!queue.empty ())
+				{
+					elements.push_back (queue.front ());
+					queue.pop ();
+				}	
+			}
+
 			Element * GetNext ()
 			{
 				std::unique_lock<std::mutex> l(m_QueueMutex);
@@ -100,8 +125,102 @@ namespace util
 			std::condition_variable m_NonEmpty;
 	};	
 
+	// multiple producers don't lock, single consumer takes all elements at once
+	// consumer is notified only when queue becomes non-empty
+	// intrusive, Element has 'next' pointer owned by queue while element is in it, no allocation per element
+	// remaining elements are not deleted, same as Queue
+	template<typename Element>
+	class MPSCQueue
+	{
+		public:
+
+			MPSCQueue (): m_Head (nullptr), m_IsWokenUp (false) {};
+
+			void Put (Element * e)
+			{
+				Push (e, e);
+			}
+
+			void PutMany (const std::vector<Element *>& elements)
+			{
+				if (elements.empty ()) return;
+				Element * first = nullptr, * last = nullptr;
+				for (auto it: elements)
+				{
+					// list is LIFO, last element goes first
+					it->next = first;
+					if (!last) last = it;
+					first = it;
+				}	
+				Push (first, last);
+			}
+
+			void GetAll (std::vector<Element *>& elements) // appends in FIFO order, doesn't wait
+			{
+				Element * e = m_Head.exchange (nullptr, std::memory_order_acquire);
+				size_t offset = elements.size ();
+				while (e)
+				{
+					elements.push_back (e);
+					e = e->next;
+				}	
+				std::reverse (elements.begin () + offset, elements.end ());
+			}
+
+			void GetAllWithTimeout (std::vector<Element *>& elements, int msec)
+			{
+				if (IsEmpty ())
+				{
+					std::unique_lock<std::mutex> l(m_NonEmptyMutex);
+					m_NonEmpty.wait_for (l, std::chrono::milliseconds (msec), 
+						[this]() { return !IsEmpty () || m_IsWokenUp; });
+					m_IsWokenUp = false;
+				}	
+				GetAll (elements);
+			}
+
+			void Wait () // until non-empty or woken up
+			{
+				std::unique_lock<std::mutex> l(m_NonEmptyMutex);
+				m_NonEmpty.wait (l, [this]() { return !IsEmpty () || m_IsWokenUp; });
+				m_IsWokenUp = false;
+			}
+
+			bool IsEmpty () const { return !m_Head.load (std::memory_order_relaxed); };
+
+			void WakeUp () 
+			{ 
+				std::unique_lock<std::mutex> l(m_NonEmptyMutex);
+				m_IsWokenUp = true;
+				m_NonEmpty.notify_all (); 
+			};
+
+		private:
+
+			void Push (Element * first, Element * last)
+			{
+				Element * head = m_Head.load (std::memory_order_relaxed);
+				do
+					last->next = head;
+				while (!m_Head.compare_exchange_weak (head, first, std::memory_order_release, std::memory_order_relaxed));
+				if (!head) 
+				{
+					// was empty. Consumer either checks emptiness under the mutex or already waits 
+					{ std::unique_lock<std::mutex> l(m_NonEmptyMutex); }
+					m_NonEmpty.notify_one ();
+				}	
+			}	
+
+		private:
+
+			std::atomic<Element *> m_Head; // most recent first
+			std::mutex m_NonEmptyMutex;
+			std::condition_variable m_NonEmpty;
+			bool m_IsWokenUp;
+	};	
+
 	template<class Msg>
-	class MsgQueue: public Queue<Msg>
+	class MsgQueue: public MPSCQueue<Msg>
 	{
 		public:
 
@@ -114,7 +233,7 @@ namespace util
 				if (m_IsRunning)
 				{
 					m_IsRunning = false;
-					Queue<Msg>::WakeUp ();					
+					MPSCQueue<Msg>::WakeUp ();					
 					m_Thread.join();
 				}
 			}
@@ -125,17 +244,23 @@ namespace util
 
 			void Run ()
 			{
-				while (m_IsRunning)
+				std::vector<Msg *> msgs;
+				while (m_IsRunning || !MPSCQueue<Msg>::IsEmpty ()) // process what was put before stop
 				{
-					while (Msg * msg = Queue<Msg>::Get ())
+					msgs.clear ();
+					MPSCQueue<Msg>::GetAll (msgs);
+					for (auto msg: msgs)
 					{
 						msg->Process ();
 						delete msg;
 					}
-					if (m_OnEmpty != nullptr)
-						m_OnEmpty ();
-					if (m_IsRunning)
-						Queue<Msg>::Wait ();
+					if (MPSCQueue<Msg>::IsEmpty ())
+					{	
+						if (m_OnEmpty != nullptr)
+							m_OnEmpty ();
+						if (m_IsRunning)
+							MPSCQueue<Msg>::Wait ();
+					}	
 				}	
 			}	
 			
@@ -25,13 +25,13 @@ namespace data
 		ReadFromFile ();
 	}	
 
-	RouterInfo::RouterInfo (const uint8_t * buf, int len):
+	RouterInfo::RouterInfo (const uint8_t * buf, int len, bool verifySignature):
 		m_IsUpdated (true), m_IsUnreachable (false), m_SupportedTransports (0), m_Caps (0)
 	{
 		m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
 		memcpy (m_Buffer, buf, len);
 		m_BufferLen = len;
-		ReadFromBuffer (true);
+		ReadFromBuffer (verifySignature);
 	}	
 
 	RouterInfo::~RouterInfo ()
@@ -39,7 +39,7 @@ namespace data
 		delete m_Buffer;
 	}	
 		
-	void RouterInfo::Update (const uint8_t * buf, int len)
+	void RouterInfo::Update (const uint8_t * buf, int len, bool verifySignature)
 	{
 		if (!m_Buffer)	
 			m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
@@ -51,9 +51,19 @@ namespace data
 		m_Properties.clear ();
 		memcpy (m_Buffer, buf, len);
 		m_BufferLen = len;
-		ReadFromBuffer (true);
+		ReadFromBuffer (verifySignature);
 		// don't delete buffer until save to file
 	}	
+
+	bool RouterInfo::VerifySignature (const uint8_t * buf, size_t len)
+	{
+		if (len > (size_t)MAX_RI_BUFFER_SIZE) return false;
+		IdentityEx identity;
+		size_t identityLen = identity.FromBuffer (buf, len);
+		if (!identityLen || identityLen + identity.GetSignatureLen () > len) return false;
+		size_t l = len - identity.GetSignatureLen ();
+		return identity.Verify (buf, l, buf + l);
+	}	
 		
 	void RouterInfo::SetRouterIdentity (const IdentityEx& identity)
 	{	
@@ -87,7 +87,7 @@ namespace data
 			RouterInfo (): m_Buffer (nullptr) { };
 			RouterInfo (const RouterInfo& ) = default;
 			RouterInfo& operator=(const RouterInfo& ) = default;
-			RouterInfo (const uint8_t * buf, int len);
+			RouterInfo (const uint8_t * buf, int len, bool verifySignature = true);
 			~RouterInfo ();
 			
 			const IdentityEx& GetRouterIdentity () const { return m_RouterIdentity; };
@@ -134,7 +134,7 @@ namespace data
 			void SetUpdated (bool updated) { m_IsUpdated = updated; }; 
 			void SaveToFile (const std::string& fullPath);
 
-			void Update (const uint8_t * buf, int len);
+			void Update (const uint8_t * buf, int len, bool verifySignature = true);
 			void DeleteBuffer () { delete m_Buffer; m_Buffer = nullptr; };
 			
 			// implements RoutingDestination
@@ -142,6 +142,7 @@ namespace data
 			const uint8_t * GetEncryptionPublicKey () const { return m_RouterIdentity.GetStandardIdentity ().publicKey; };
 			bool IsDestination () const { return false; };
 
+			static bool VerifySignature (const uint8_t * buf, size_t len); // thread safe, doesn't create RouterInfo
 			
 		private:
 
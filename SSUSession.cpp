@@ -6,6 +6,7 @@
 #include "Timestamp.h"
 #include "RouterContext.h"
 #include "Transports.h"
+#include "Profiling.h"
 #include "SSU.h"
 #include "SSUSession.h"
 
@@ -721,6 +722,8 @@ namespace transport
 		{
 			// timeout expired
 			LogPrint ("SSU session was not established after ", SSU_CONNECT_TIMEOUT, " second");
+			if (m_RemoteRouter)
+				i2p::data::profiles.ConnectFailed (m_RemoteRouter->GetIdentHash ());
 			Failed ();
 		}	
 	}	
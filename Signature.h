@@ -23,6 +23,8 @@ namespace crypto
 			virtual size_t GetPublicKeyLen () const = 0;
 			virtual size_t GetSignatureLen () const = 0;
 			virtual size_t GetPrivateKeyLen () const { return GetSignatureLen ()/2; };
+			virtual void Precompute () {}; // for frequently used keys, before verifier gets shared
+			virtual bool IsPrecomputed () const { return false; };
 	};
 
 	class Signer
@@ -40,7 +42,7 @@ namespace crypto
 	{
 		public:
 
-			DSAVerifier (const uint8_t * signingKey)
+			DSAVerifier (const uint8_t * signingKey): m_IsPrecomputed (false)
 			{
 				m_PublicKey.Initialize (dsap, dsaq, dsag, CryptoPP::Integer (signingKey, DSA_PUBLIC_KEY_LENGTH));
 			}
@@ -53,10 +55,13 @@ namespace crypto
 
 			size_t GetPublicKeyLen () const { return DSA_PUBLIC_KEY_LENGTH; };
 			size_t GetSignatureLen () const { return DSA_SIGNATURE_LENGTH; };
+			void Precompute () { m_PublicKey.Precompute (); m_IsPrecomputed = true; }; // g and y
+			bool IsPrecomputed () const { return m_IsPrecomputed; };
 			
 		private:
 
 			CryptoPP::DSA::PublicKey m_PublicKey;
+			bool m_IsPrecomputed;
 	};
 
 	class DSASigner: public Signer
@@ -95,7 +100,7 @@ namespace crypto
 		public:
 
 			template<typename Curve>
-			ECDSAVerifier (Curve curve, const uint8_t * signingKey)
+			ECDSAVerifier (Curve curve, const uint8_t * signingKey): m_IsPrecomputed (false)
 			{
 				m_PublicKey.Initialize (curve, 
 					CryptoPP::ECP::Point (CryptoPP::Integer (signingKey, keyLen/2), 
@@ -110,10 +115,13 @@ namespace crypto
 
 			size_t GetPublicKeyLen () const { return keyLen; };
 			size_t GetSignatureLen () const { return keyLen; }; // signature length = key length
+			void Precompute () { m_PublicKey.Precompute (); m_IsPrecomputed = true; }; // base point and Q
+			bool IsPrecomputed () const { return m_IsPrecomputed; };
 			
 		private:
 
 			typename CryptoPP::ECDSA<CryptoPP::ECP, Hash>::PublicKey m_PublicKey;
+			bool m_IsPrecomputed;
 	};
 
 	template<typename Hash>
@@ -500,6 +500,16 @@ namespace stream
 				return;
 			}
 		}
+		auto& owner = m_LocalDestination.GetOwner ();
+		if (owner.IsLocalLoopback (m_RemoteLeaseSet->GetIdentHash ()))
+		{
+			for (auto it: packets)
+			{
+				owner.SendLocalDataMessage (m_RemoteLeaseSet->GetIdentHash (), CreateDataMessage (it->GetBuffer (), it->GetLength ()));
+				m_NumSentBytes += it->GetLength ();
+			}
+			return;
+		}	
 		m_CurrentOutboundTunnel = m_LocalDestination.GetOwner ().GetTunnelPool ()->GetNextOutboundTunnel (m_CurrentOutboundTunnel);
 		if (!m_CurrentOutboundTunnel)
 		{
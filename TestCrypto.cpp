@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+#include "CPU.h"
+#include "TunnelBase.h"
+#include "aes.h"
+#include "sha256.h"
+#include "TransitTunnel.h"
+
+// crypto self tests, multi-block kernels must match single-block routines
+// usage: test_crypto, exit status is non-zero if any test failed
+
+const int TEST_MAX_NUM_BLOCKS = 41; // more than 2*16, every remainder of 4, 8 and 16
+const int TEST_NUM_ROUNDS = 8; // with different keys and IVs
+const size_t TEST_MAX_HASH_LEN = 200; // more than 3 SHA-256 blocks, every padding case
+
+static int numFailed = 0;
+
+static void Check (const char * name, int num, bool ok) // num of blocks, messages or bytes
+{
+	if (!ok)
+	{
+		printf ("%s of %d FAILED\n", name, num);
+		numFailed++;
+	}
+}
+
+static void TestECB (CryptoPP::RandomNumberGenerator& rnd)
+{
+	const size_t len = TEST_MAX_NUM_BLOCKS*16;
+	i2p::crypto::AESAlignedBuffer<len> in, expected, out;
+	uint8_t key[32];
+	for (int r = 0; r < TEST_NUM_ROUNDS; r++)
+	for (int n = 1; n <= TEST_MAX_NUM_BLOCKS; n++)
+	{
+		rnd.GenerateBlock (key, 32);
+		rnd.GenerateBlock (in, len);
+		auto blocksIn = (const i2p::crypto::ChipherBlock *)(const uint8_t *)in;
+		i2p::crypto::ECBEncryption encryption;
+		encryption.SetKey (key);
+		for (int i = 0; i < n; i++)
+			encryption.Encrypt (blocksIn + i, (i2p::crypto::ChipherBlock *)(expected + i*16));
+		encryption.Encrypt (n, blocksIn, (i2p::crypto::ChipherBlock *)(uint8_t *)out);
+		Check ("ECB encryption", n, !memcmp (out, expected, n*16));
+
+		i2p::crypto::ECBDecryption decryption;
+		decryption.SetKey (key);
+		for (int i = 0; i < n; i++)
+			decryption.Decrypt (blocksIn + i, (i2p::crypto::ChipherBlock *)(expected + i*16));
+		decryption.Decrypt (n, blocksIn, (i2p::crypto::ChipherBlock *)(uint8_t *)out);
+		Check ("ECB decryption", n, !memcmp (out, expected, n*16));
+		memcpy (out, in, n*16);
+		decryption.Decrypt (n, (i2p::crypto::ChipherBlock *)(uint8_t *)out, (i2p::crypto::ChipherBlock *)(uint8_t *)out);
+		Check ("ECB decryption in place", n, !memcmp (out, expected, n*16));
+	}
+}
+
+static void TestCBCDecryption (CryptoPP::RandomNumberGenerator& rnd)
+{
+	// second call continues with IV left by first one
+	const size_t len = 2*TEST_MAX_NUM_BLOCKS*16;
+	i2p::crypto::AESAlignedBuffer<len> in, expected, out;
+	uint8_t key[32], iv[16];
+	for (int r = 0; r < TEST_NUM_ROUNDS; r++)
+	for (int n = 1; n <= TEST_MAX_NUM_BLOCKS; n++)
+	{
+		rnd.GenerateBlock (key, 32);
+		rnd.GenerateBlock (iv, 16);
+		rnd.GenerateBlock (in, len);
+		i2p::crypto::CBCDecryption reference;
+		reference.SetKey (key);
+		reference.SetIV (iv);
+		for (int i = 0; i < 2*n; i++)
+			reference.Decrypt (in + i*16, expected + i*16);
+
+		i2p::crypto::CBCDecryption decryption;
+		decryption.SetKey (key);
+		decryption.SetIV (iv);
+		decryption.Decrypt (in, n*16, out);
+		decryption.Decrypt (in + n*16, n*16, out + n*16);
+		Check ("CBC decryption", n, !memcmp (out, expected, 2*n*16));
+
+		memcpy (out, in, 2*n*16);
+		decryption.SetIV (iv);
+		decryption.Decrypt (out, n*16, out);
+		decryption.Decrypt (out + n*16, n*16, out + n*16);
+		Check ("CBC decryption in place", n, !memcmp (out, expected, 2*n*16));
+
+		i2p::crypto::CBCEncryption encryption;
+		encryption.SetKey (key);
+		encryption.SetIV (iv);
+		encryption.Encrypt (expected, 2*n*16, out);
+		Check ("CBC encryption", n, !memcmp (out, in, 2*n*16));
+	}
+}
+
+static void TestTunnelDecryption (CryptoPP::RandomNumberGenerator& rnd)
+{
+	const size_t numBlocks = i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE/16;
+	i2p::crypto::AESAlignedBuffer<16 + i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE> in, expected, out;
+	uint8_t layerKey[32], ivKey[32], iv[16];
+	for (int r = 0; r < TEST_NUM_ROUNDS; r++)
+	{
+		rnd.GenerateBlock (layerKey, 32);
+		rnd.GenerateBlock (ivKey, 32);
+		rnd.GenerateBlock (in, 16 + i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE);
+		// IV is decrypted twice, data is chained to IV decrypted once
+		i2p::crypto::ECBDecryption ivDecryption;
+		ivDecryption.SetKey (ivKey);
+		ivDecryption.Decrypt ((const i2p::crypto::ChipherBlock *)(const uint8_t *)in, (i2p::crypto::ChipherBlock *)iv);
+		ivDecryption.Decrypt ((const i2p::crypto::ChipherBlock *)iv, (i2p::crypto::ChipherBlock *)(uint8_t *)expected);
+		i2p::crypto::CBCDecryption layerDecryption;
+		layerDecryption.SetKey (layerKey);
+		layerDecryption.SetIV (iv);
+		for (size_t i = 1; i <= numBlocks; i++)
+			layerDecryption.Decrypt (in + i*16, expected + i*16);
+
+		i2p::crypto::TunnelDecryption decryption;
+		decryption.SetKeys (layerKey, ivKey);
+		memcpy (out, in, 16 + i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE);
+		decryption.Decrypt (out);
+		Check ("Tunnel decryption", numBlocks + 1, !memcmp (out, expected, 16 + i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE));
+
+		i2p::crypto::TunnelEncryption encryption;
+		encryption.SetKeys (layerKey, ivKey);
+		encryption.Encrypt (out);
+		Check ("Tunnel encryption", numBlocks + 1, !memcmp (out, in, 16 + i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE));
+	}
+}
+
+static void TestTunnelBatchEncryption (CryptoPP::RandomNumberGenerator& rnd)
+{
+	// transit tunnels encrypt messages of different tunnels in lockstep
+	const int maxNum = i2p::tunnel::TRANSIT_TUNNEL_BATCH_SIZE;
+	const size_t len = 16 + i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE;
+	i2p::crypto::TunnelEncryption encryptions[maxNum];
+	i2p::crypto::TunnelEncryption * lanes[maxNum];
+	i2p::crypto::AESAlignedBuffer<len> expected[maxNum], out[maxNum];
+	uint8_t * payloads[maxNum];
+	uint8_t layerKey[32], ivKey[32];
+	for (int r = 0; r < TEST_NUM_ROUNDS; r++)
+	for (int n = 1; n <= maxNum; n++)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			rnd.GenerateBlock (layerKey, 32);
+			rnd.GenerateBlock (ivKey, 32);
+			encryptions[i].SetKeys (layerKey, ivKey);
+			lanes[i] = encryptions + i;
+			rnd.GenerateBlock (expected[i], len);
+			memcpy (out[i], expected[i], len);
+			payloads[i] = out[i];
+			encryptions[i].Encrypt (expected[i]);
+		}
+		i2p::crypto::TunnelEncryption::Encrypt (n, lanes, payloads);
+		bool ok = true;
+		for (int i = 0; i < n; i++)
+			if (memcmp (out[i], expected[i], len)) ok = false;
+		Check ("Tunnel batch encryption", n, ok);
+	}
+}
+
+static void TestSHA256 (CryptoPP::RandomNumberGenerator& rnd)
+{
+	// known answers for empty and "abc", then crypto++ for every length 
+	static const uint8_t empty[32] = 
+	{
+		0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+		0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55
+	};
+	static const uint8_t abc[32] =
+	{
+		0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+		0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+	};
+	uint8_t buf[TEST_MAX_HASH_LEN], expected[32], digest[32];
+	i2p::crypto::SHA256 ((const uint8_t *)"", 0, digest);
+	Check ("SHA256 known answer", 0, !memcmp (digest, empty, 32));
+	i2p::crypto::SHA256 ((const uint8_t *)"abc", 3, digest);
+	Check ("SHA256 known answer", 3, !memcmp (digest, abc, 32));
+	for (int r = 0; r < TEST_NUM_ROUNDS; r++)
+	for (size_t len = 0; len <= TEST_MAX_HASH_LEN; len++) 
+	{
+		rnd.GenerateBlock (buf, TEST_MAX_HASH_LEN);
+		CryptoPP::SHA256().CalculateDigest (expected, buf, len);
+		i2p::crypto::SHA256 (buf, len, digest);
+		Check ("SHA256 of bytes", len, !memcmp (digest, expected, 32));
+	}
+}
+
+static void RunTests (CryptoPP::RandomNumberGenerator& rnd)
+{
+	TestECB (rnd);
+	TestCBCDecryption (rnd);
+	TestTunnelDecryption (rnd);
+	TestTunnelBatchEncryption (rnd);
+	TestSHA256 (rnd);
+}
+
+int main ()
+{
+	i2p::cpu::Detect ();
+	printf ("Crypto implementations: %s\n", i2p::cpu::GetCryptoImplementations ().c_str ());
+	CryptoPP::AutoSeededRandomPool rnd;
+	RunTests (rnd);
+	if (i2p::cpu::vaes)
+	{
+		// 8 and 4 blocks kernels are used for remainders only otherwise
+		printf ("Crypto implementations: without VAES\n");
+		i2p::cpu::vaes = false;
+		RunTests (rnd);
+		i2p::cpu::vaes = true;
+	}
+	if (i2p::cpu::shani)
+	{
+		printf ("Crypto implementations: without SHA-NI\n");
+		i2p::cpu::shani = false;
+		TestSHA256 (rnd);
+		i2p::cpu::shani = true;
+	}
+	if (numFailed)
+	{
+		printf ("%d tests FAILED\n", numFailed);
+		return EXIT_FAILURE;
+	}
+	printf ("All tests passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+#ifndef TIMING_WHEEL_H__
+#define TIMING_WHEEL_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <vector>
+
+namespace i2p
+{
+namespace util
+{
+	const int TIMING_WHEEL_NUM_SLOTS = 64; // power of 2
+	const int TIMING_WHEEL_SLOT_BITS = 6;
+	const uint32_t TIMING_WHEEL_SPAN = TIMING_WHEEL_NUM_SLOTS*TIMING_WHEEL_NUM_SLOTS; // seconds covered by both levels
+
+	// hierarchical timing wheel with second resolution
+	// level 0 slot is a second, level 1 slot is 64 seconds, later expirations wait in overflow
+	// work is proportional to number of expired items and elapsed seconds. Not thread safe
+	template<typename T>
+	class TimingWheel
+	{
+		struct Entry
+		{
+			T item;
+			uint32_t expirationTime;
+		};
+
+		public:
+
+			TimingWheel (uint32_t ts): m_CurrentTime (ts), m_Size (0) {};
+
+			void Schedule (const T& item, uint32_t expirationTime) // in seconds since epoch
+			{
+				Insert (Entry { item, expirationTime });
+				m_Size++;
+			}
+
+			void Advance (uint32_t ts, std::vector<T>& expired) // appends items expired by ts
+			{
+				if (ts <= m_CurrentTime) return;
+				if (ts - m_CurrentTime > TIMING_WHEEL_SPAN)
+				{
+					// clock jump, rearrange everything
+					std::vector<Entry> entries;
+					entries.swap (m_Overflow);
+					for (int l = 0; l < 2; l++)
+						for (int i = 0; i < TIMING_WHEEL_NUM_SLOTS; i++)
+						{
+							entries.insert (entries.end (), m_Slots[l][i].begin (), m_Slots[l][i].end ());
+							m_Slots[l][i].clear ();
+						}
+					m_CurrentTime = ts;
+					Reinsert (entries, expired);
+					return;
+				}
+				while (m_CurrentTime < ts)
+				{
+					m_CurrentTime++;
+					if (!(m_CurrentTime & (TIMING_WHEEL_NUM_SLOTS - 1)))
+					{
+						// new level 1 round, move next 64 seconds to level 0
+						uint32_t slot = (m_CurrentTime >> TIMING_WHEEL_SLOT_BITS) & (TIMING_WHEEL_NUM_SLOTS - 1);
+						if (!slot && !m_Overflow.empty ())
+						{
+							std::vector<Entry> entries;
+							entries.swap (m_Overflow);
+							Reinsert (entries, expired);
+						}
+						if (!m_Slots[1][slot].empty ())
+						{
+							std::vector<Entry> entries;
+							entries.swap (m_Slots[1][slot]);
+							Reinsert (entries, expired);
+						}
+					}
+					auto& slot = m_Slots[0][m_CurrentTime & (TIMING_WHEEL_NUM_SLOTS - 1)];
+					if (!slot.empty ())
+					{
+						std::vector<Entry> entries;
+						entries.swap (slot);
+						Reinsert (entries, expired);
+					}
+				}
+			}
+
+			size_t GetSize () const { return m_Size; };
+
+		private:
+
+			void Insert (const Entry& entry)
+			{
+				// already expired entries go to the next second
+				uint32_t t = entry.expirationTime > m_CurrentTime ? entry.expirationTime : m_CurrentTime + 1;
+				uint32_t delta = t - m_CurrentTime;
+				if (delta < (uint32_t)TIMING_WHEEL_NUM_SLOTS)
+					m_Slots[0][t & (TIMING_WHEEL_NUM_SLOTS - 1)].push_back (entry);
+				else if (delta < TIMING_WHEEL_SPAN)
+					m_Slots[1][(t >> TIMING_WHEEL_SLOT_BITS) & (TIMING_WHEEL_NUM_SLOTS - 1)].push_back (entry);
+				else
+					m_Overflow.push_back (entry);
+			}
+
+			void Reinsert (const std::vector<Entry>& entries, std::vector<T>& expired)
+			{
+				for (auto& it: entries)
+					if (it.expirationTime <= m_CurrentTime)
+					{
+						expired.push_back (it.item);
+						m_Size--;
+					}
+					else
+						Insert (it);
+			}
+
+		private:
+
+			std::vector<Entry> m_Slots[2][TIMING_WHEEL_NUM_SLOTS], m_Overflow;
+			uint32_t m_CurrentTime; // everything up to it has expired
+			size_t m_Size;
+	};
+}
+}
+
+#endif
@@ -25,10 +25,36 @@ namespace tunnel
 		m_Encryption.Encrypt (tunnelMsg->GetPayload () + 4); 
 	}	
 	
+	void TransitTunnel::EncryptTunnelMsgs (int num, TransitTunnel * const * tunnels, I2NPMessage * const * tunnelMsgs)
+	{
+		i2p::crypto::TunnelEncryption * encryptions[TRANSIT_TUNNEL_BATCH_SIZE];
+		uint8_t * payloads[TRANSIT_TUNNEL_BATCH_SIZE];
+		while (num > 0)
+		{
+			int n = num < TRANSIT_TUNNEL_BATCH_SIZE ? num : TRANSIT_TUNNEL_BATCH_SIZE;
+			for (int i = 0; i < n; i++)
+			{
+				encryptions[i] = &tunnels[i]->m_Encryption;
+				payloads[i] = tunnelMsgs[i]->GetPayload () + 4;
+			}	
+			i2p::crypto::TunnelEncryption::Encrypt (n, encryptions, payloads);
+			num -= n; tunnels += n; tunnelMsgs += n;
+		}
+	}	
+	
 	void TransitTunnel::HandleTunnelDataMsg (i2p::I2NPMessage * tunnelMsg)
 	{
+		if (!transitBandwidthLimiter.Accept (tunnelMsg->GetLength ()))
+		{
+			i2p::DeleteI2NPMessage (tunnelMsg);
+			return;
+		}	
 		EncryptTunnelMsg (tunnelMsg);
-		
+		HandleEncryptedTunnelDataMsg (tunnelMsg);
+	}
+
+	void TransitTunnel::HandleEncryptedTunnelDataMsg (i2p::I2NPMessage * tunnelMsg)
+	{
 		LogPrint ("TransitTunnel: ",m_TunnelID,"->", m_NextTunnelID);
 		m_NumTransmittedBytes += tunnelMsg->GetLength ();
 		*(uint32_t *)(tunnelMsg->GetPayload ()) = htobe32 (m_NextTunnelID);
@@ -45,21 +71,120 @@ namespace tunnel
 
 	void TransitTunnelGateway::SendTunnelDataMsg (i2p::I2NPMessage * msg)
 	{
+		// goes out as fragments in tunnel data messages
+		size_t len = msg->GetLength ();
+		size_t numTunnelMsgs = (len + TUNNEL_DATA_MAX_PAYLOAD_SIZE - 1)/TUNNEL_DATA_MAX_PAYLOAD_SIZE;
+		if (!transitBandwidthLimiter.Accept (len, numTunnelMsgs*TUNNEL_DATA_MSG_SIZE))
+		{
+			LogPrint ("Transit bandwidth exceeded. Message for gateway ", GetTunnelID (), " dropped");
+			i2p::DeleteI2NPMessage (msg);
+			return;
+		}	
 		TunnelMessageBlock block;
 		block.deliveryType = eDeliveryTypeLocal;
 		block.data = msg;
-		std::unique_lock<std::mutex> l(m_SendMutex);
 		m_Gateway.SendTunnelDataMsg (block);
 	}		
 
-	void TransitTunnelEndpoint::HandleTunnelDataMsg (i2p::I2NPMessage * tunnelMsg)
+	void TransitTunnelEndpoint::HandleEncryptedTunnelDataMsg (i2p::I2NPMessage * tunnelMsg)
 	{
-		EncryptTunnelMsg (tunnelMsg);
-		
 		LogPrint ("TransitTunnel endpoint for ", GetTunnelID ());
 		m_Endpoint.HandleDecryptedTunnelDataMsg (tunnelMsg); 
 	}
 		
+	void TokenBucket::SetRate (uint64_t rate)
+	{
+		m_Rate = rate;
+		m_Tokens = rate*1000;
+		m_LastUpdateTime = i2p::util::GetMillisecondsSinceEpoch ();
+	}	
+
+	void TokenBucket::Refill ()
+	{
+		uint64_t ts = i2p::util::GetMillisecondsSinceEpoch ();
+		uint64_t lastUpdateTime = m_LastUpdateTime;
+		if (ts <= lastUpdateTime || !m_LastUpdateTime.compare_exchange_strong (lastUpdateTime, ts)) 
+			return; // same millisecond or refilled by another thread
+		int64_t rate = m_Rate, tokens = m_Tokens, newTokens; 
+		do 
+		{
+			newTokens = tokens + (int64_t)(ts - lastUpdateTime)*rate; // nothing is lost to truncation
+			if (newTokens > rate*1000) newTokens = rate*1000; // burst
+		}
+		while (!m_Tokens.compare_exchange_weak (tokens, newTokens));
+	}	
+
+	bool TokenBucket::Consume (size_t len)
+	{
+		if (!m_Rate) return true; // unlimited
+		Refill ();
+		int64_t tokens = len*1000;
+		if (m_Tokens.fetch_sub (tokens) >= tokens) return true;
+		m_Tokens += tokens; // not enough
+		return false;
+	}	
+
+	TransitBandwidthLimiter transitBandwidthLimiter;
+
+	void TransitBandwidthLimiter::SetLimits (int inboundKBps, int outboundKBps, int share)
+	{
+		if (share <= 0 || share > 100) share = TRANSIT_BANDWIDTH_DEFAULT_SHARE;
+		m_Share = share;
+		m_Inbound.SetRate (inboundKBps > 0 ? inboundKBps*1024LL*share/100 : 0); 
+		m_Outbound.SetRate (outboundKBps > 0 ? outboundKBps*1024LL*share/100 : 0); 
+		if (inboundKBps > 0 || outboundKBps > 0)
+			LogPrint ("Transit bandwidth limited to ", share, "% of ", inboundKBps, " KBps inbound, ", outboundKBps, " KBps outbound");
+	}	
+
+	bool TransitBandwidthLimiter::Accept (size_t inboundLen, size_t outboundLen)
+	{
+		if (!m_Inbound.Consume (inboundLen))
+		{
+			m_NumDroppedMsgs++;
+			return false;
+		}	
+		if (!m_Outbound.Consume (outboundLen))
+		{
+			m_Inbound.Refund (inboundLen);
+			m_NumDroppedMsgs++;
+			return false;
+		}	
+		m_NumInboundBytes += inboundLen;
+		m_NumOutboundBytes += outboundLen;
+		return true;
+	}	
+
+	bool TransitBandwidthLimiter::AcceptsNewTunnel ()
+	{
+		size_t numTransitTunnels = m_NumTransitTunnels;
+		if (!numTransitTunnels) return true;
+		// assume new tunnel brings average load of existing ones
+		uint64_t inboundLimit = GetInboundLimit (), outboundLimit = GetOutboundLimit (),
+			inboundRate = m_InboundRate, outboundRate = m_OutboundRate;
+		if ((inboundLimit && inboundRate + inboundRate/numTransitTunnels > inboundLimit) ||
+			(outboundLimit && outboundRate + outboundRate/numTransitTunnels > outboundLimit))
+		{
+			m_NumRejectedTunnels++;
+			return false;
+		}
+		return true;
+	}	
+
+	void TransitBandwidthLimiter::UpdateRates (size_t numTransitTunnels)
+	{
+		m_NumTransitTunnels = numTransitTunnels;
+		uint64_t ts = i2p::util::GetMillisecondsSinceEpoch ();
+		uint64_t numInboundBytes = m_NumInboundBytes, numOutboundBytes = m_NumOutboundBytes;
+		if (m_LastUpdateTime && ts > m_LastUpdateTime)
+		{
+			m_InboundRate = (numInboundBytes - m_LastInboundBytes)*1000/(ts - m_LastUpdateTime);
+			m_OutboundRate = (numOutboundBytes - m_LastOutboundBytes)*1000/(ts - m_LastUpdateTime);
+		}	
+		m_LastInboundBytes = numInboundBytes;
+		m_LastOutboundBytes = numOutboundBytes;
+		m_LastUpdateTime = ts;
+	}	
+
 	TransitTunnel * CreateTransitTunnel (uint32_t receiveTunnelID,
 		const uint8_t * nextIdent, uint32_t nextTunnelID, 
 	    const uint8_t * layerKey,const uint8_t * ivKey, 
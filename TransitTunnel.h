@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <mutex>
+#include <atomic>
 #include "aes.h"
 #include "I2NPProtocol.h"
 #include "TunnelEndpoint.h"
@@ -13,6 +14,65 @@ namespace i2p
 {
 namespace tunnel
 {	
+	const int TRANSIT_TUNNEL_BATCH_SIZE = 16; // tunnel data messages encrypted at once
+	const int TRANSIT_BANDWIDTH_DEFAULT_SHARE = 80; // percent of bandwidth limits available for transit
+	const int TRANSIT_BANDWIDTH_REJECT_CODE = 30; // bandwidth reason
+
+	class TokenBucket // lock-free, in bytes
+	{
+		public:
+
+			TokenBucket (): m_Rate (0), m_Tokens (0), m_LastUpdateTime (0) {};
+			void SetRate (uint64_t rate); // bytes per second, 0 means unlimited, burst is one second
+			uint64_t GetRate () const { return m_Rate; };
+			bool Consume (size_t len); // false if not enough tokens
+			void Refund (size_t len) { m_Tokens += len*1000; };
+
+		private:
+
+			void Refill ();
+
+		private:
+
+			std::atomic<uint64_t> m_Rate;
+			std::atomic<int64_t> m_Tokens; // in 1/1000 of byte, milliseconds times rate without rounding
+			std::atomic<uint64_t> m_LastUpdateTime; // in milliseconds
+	};	
+
+	class TransitBandwidthLimiter 
+	{
+		public:
+
+			TransitBandwidthLimiter (): m_Share (TRANSIT_BANDWIDTH_DEFAULT_SHARE), 
+				m_NumInboundBytes (0), m_NumOutboundBytes (0), m_InboundRate (0), m_OutboundRate (0), 
+				m_NumTransitTunnels (0), m_NumDroppedMsgs (0), m_NumRejectedTunnels (0),
+				m_LastInboundBytes (0), m_LastOutboundBytes (0), m_LastUpdateTime (0) {};
+
+			void SetLimits (int inboundKBps, int outboundKBps, int share); // 0 means unlimited
+			bool Accept (size_t len) { return Accept (len, len); }; // tunnel data message, dropped if false
+			bool Accept (size_t inboundLen, size_t outboundLen); // gateway sends more than receives
+			bool AcceptsNewTunnel (); // projected load with one more tunnel fits share
+			void UpdateRates (size_t numTransitTunnels); // called periodically from tunnels thread
+
+			uint64_t GetInboundLimit () const { return m_Inbound.GetRate (); }; // bytes per second, 0 if unlimited
+			uint64_t GetOutboundLimit () const { return m_Outbound.GetRate (); };
+			uint64_t GetInboundRate () const { return m_InboundRate; };
+			uint64_t GetOutboundRate () const { return m_OutboundRate; };
+			int GetShare () const { return m_Share; };
+			size_t GetNumDroppedMsgs () const { return m_NumDroppedMsgs; };
+			size_t GetNumRejectedTunnels () const { return m_NumRejectedTunnels; };
+
+		private:
+
+			TokenBucket m_Inbound, m_Outbound;
+			int m_Share;
+			std::atomic<uint64_t> m_NumInboundBytes, m_NumOutboundBytes, m_InboundRate, m_OutboundRate;
+			std::atomic<size_t> m_NumTransitTunnels, m_NumDroppedMsgs, m_NumRejectedTunnels;
+			uint64_t m_LastInboundBytes, m_LastOutboundBytes, m_LastUpdateTime;
+	};	
+
+	extern TransitBandwidthLimiter transitBandwidthLimiter;
+
 	class TransitTunnel: public TunnelBase // tunnel patricipant
 	{
 		public:
@@ -21,7 +81,8 @@ namespace tunnel
 			    const uint8_t * nextIdent, uint32_t nextTunnelID, 
 	    		const uint8_t * layerKey,const uint8_t * ivKey); 
 			
-			virtual void HandleTunnelDataMsg (i2p::I2NPMessage * tunnelMsg);
+			void HandleTunnelDataMsg (i2p::I2NPMessage * tunnelMsg); // encrypt and handle
+			virtual void HandleEncryptedTunnelDataMsg (i2p::I2NPMessage * tunnelMsg);
 			virtual void SendTunnelDataMsg (i2p::I2NPMessage * msg);
 			virtual size_t GetNumTransmittedBytes () const { return m_NumTransmittedBytes; };
 			
@@ -29,6 +90,7 @@ namespace tunnel
 
 			// implements TunnelBase
 			void EncryptTunnelMsg (I2NPMessage * tunnelMsg); 
+			static void EncryptTunnelMsgs (int num, TransitTunnel * const * tunnels, I2NPMessage * const * tunnelMsgs); // in lockstep
 			uint32_t GetNextTunnelID () const { return m_NextTunnelID; };
 			const i2p::data::IdentHash& GetNextIdentHash () const { return m_NextIdent; };
 			
@@ -56,7 +118,6 @@ namespace tunnel
 			
 		private:
 
-			std::mutex m_SendMutex;
 			TunnelGateway m_Gateway;
 	};	
 
@@ -70,7 +131,7 @@ namespace tunnel
 				TransitTunnel (receiveTunnelID, nextIdent, nextTunnelID, layerKey, ivKey),
 				m_Endpoint (false) {}; // transit endpoint is always outbound
 
-			void HandleTunnelDataMsg (i2p::I2NPMessage * tunnelMsg);
+			void HandleEncryptedTunnelDataMsg (i2p::I2NPMessage * tunnelMsg);
 			size_t GetNumTransmittedBytes () const { return m_Endpoint.GetNumReceivedBytes (); }
 			
 		private:
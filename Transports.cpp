@@ -1,10 +1,10 @@
-#include <cryptopp/dh.h>
 #include <boost/bind.hpp>
 #include "Log.h"
 #include "CryptoConst.h"
 #include "RouterContext.h"
 #include "I2NPProtocol.h"
 #include "NetDb.h"
+#include "Profiling.h"
 #include "Transports.h"
 
 using namespace i2p::data;
@@ -57,11 +57,10 @@ namespace transport
 	{
 		if (num > 0)
 		{
-			CryptoPP::DH dh (i2p::crypto::elgp, i2p::crypto::elgg);
 			for (int i = 0; i < num; i++)
 			{
 				i2p::transport::DHKeysPair * pair = new i2p::transport::DHKeysPair ();
-				dh.GenerateKeyPair(m_Rnd, pair->privateKey, pair->publicKey);
+				i2p::crypto::GenerateElGamalKeyPair (m_Rnd, pair->privateKey, pair->publicKey);
 				std::unique_lock<std::mutex>  l(m_AcquiredMutex);
 				m_Queue.push (pair);
 			}
@@ -81,8 +80,7 @@ namespace transport
 		else // queue is empty, create new
 		{
 			DHKeysPair * pair = new DHKeysPair ();
-			CryptoPP::DH dh (i2p::crypto::elgp, i2p::crypto::elgg);
-			dh.GenerateKeyPair(m_Rnd, pair->privateKey, pair->publicKey);
+			i2p::crypto::GenerateElGamalKeyPair (m_Rnd, pair->privateKey, pair->publicKey);
 			return pair;
 		}
 	}
@@ -255,6 +253,7 @@ namespace transport
 			if (ecode != boost::asio::error::operation_aborted)
 			{
 				i2p::data::netdb.SetUnreachable (conn->GetRemoteIdentity ().GetIdentHash (), true);
+				i2p::data::profiles.ConnectFailed (conn->GetRemoteIdentity ().GetIdentHash ());
 				conn->Terminate ();
 			}
 		}
@@ -285,6 +284,7 @@ namespace transport
 
 	void Transports::SendMessage (const i2p::data::IdentHash& ident, i2p::I2NPMessage * msg)
 	{
+		msg = i2p::UnshareI2NPMessage (msg); // NTCP and SSU modify buffer in place
 		if (ident == i2p::context.GetRouterInfo ().GetIdentHash ())
 			// we send it to ourself
 			i2p::HandleI2NPMessage (msg);
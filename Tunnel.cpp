@@ -2,13 +2,17 @@
 #include <thread>
 #include <algorithm>
 #include <vector> 
+#include <limits>
 #include <cryptopp/sha.h>
 #include "RouterContext.h"
 #include "Log.h"
+#include "ElGamal.h"
 #include "Timestamp.h"
+#include "util.h"
 #include "I2NPProtocol.h"
 #include "Transports.h"
 #include "NetDb.h"
+#include "Profiling.h"
 #include "Tunnel.h"
 
 namespace i2p
@@ -17,7 +21,8 @@ namespace tunnel
 {		
 	
 	Tunnel::Tunnel (TunnelConfig * config): 
-		m_Config (config), m_Pool (nullptr), m_State (eTunnelStatePending)
+		m_Config (config), m_Pool (nullptr), m_State (eTunnelStatePending), m_Latency (0),
+		m_BuildStartTime (0)
 	{
 	}	
 
@@ -29,6 +34,7 @@ namespace tunnel
 	void Tunnel::Build (uint32_t replyMsgID, OutboundTunnel * outboundTunnel)
 	{
 		CryptoPP::RandomNumberGenerator& rnd = i2p::context.GetRandomNumberGenerator ();
+		m_BuildStartTime = i2p::util::GetMillisecondsSinceEpoch ();
 		auto numHops = m_Config->GetNumHops ();
 		int numRecords = numHops <= STANDARD_NUM_RECORDS ? STANDARD_NUM_RECORDS : numHops; 
 		I2NPMessage * msg = NewI2NPMessage ();
@@ -128,6 +134,7 @@ namespace tunnel
 		{			
 			I2NPBuildResponseRecord * record = (I2NPBuildResponseRecord *)(msg + 1 + hop->recordIndex*sizeof (I2NPBuildResponseRecord));
 			LogPrint ("Ret code=", (int)record->ret);
+			i2p::data::profiles.TunnelBuildResponse (hop->router->GetIdentHash (), !record->ret);
 			if (record->ret) 
 				// if any of participants declined the tunnel is not established
 				established = false; 
@@ -147,6 +154,15 @@ namespace tunnel
 		return established;
 	}	
 
+	void Tunnel::AddLatencySample (int latency)
+	{
+		if (latency <= 0) latency = 1; // 0 means unknown
+		if (m_Latency)
+			m_Latency += (latency - m_Latency)/TUNNEL_LATENCY_EWMA_WEIGHT;
+		else
+			m_Latency = latency; // first sample
+	}	
+
 	void Tunnel::EncryptTunnelMsg (I2NPMessage * tunnelMsg)
 	{
 		uint8_t * payload = tunnelMsg->GetPayload () + 4;
@@ -183,29 +199,29 @@ namespace tunnel
 		else	
 			block.deliveryType = eDeliveryTypeLocal;
 		block.data = msg;
-		
-		std::unique_lock<std::mutex> l(m_SendMutex);
 		m_Gateway.SendTunnelDataMsg (block);
 	}
 		
 	void OutboundTunnel::SendTunnelDataMsg (const std::vector<TunnelMessageBlock>& msgs)
 	{
-		std::unique_lock<std::mutex> l(m_SendMutex);
-		for (auto& it : msgs)
-			m_Gateway.PutTunnelDataMsg (it);
-		m_Gateway.SendBuffer ();
+		m_Gateway.SendTunnelDataMsgs (msgs);
 	}	
 	
 	Tunnels tunnels;
 	
-	Tunnels::Tunnels (): m_IsRunning (false), m_Thread (nullptr), m_ExploratoryPool (nullptr)
+	Tunnels::Tunnels (): m_IsRunning (false), m_Thread (nullptr), m_NumWorkers (0), m_TablesEpoch (0),
+		m_InboundTunnelsTable (m_TablesEpoch), m_TransitTunnelsTable (m_TablesEpoch), 
+		m_InboundTunnelsExpiration (i2p::util::GetSecondsSinceEpoch ()), 
+		m_OutboundTunnelsExpiration (i2p::util::GetSecondsSinceEpoch ()),
+		m_TransitTunnelsExpiration (i2p::util::GetSecondsSinceEpoch ()), m_ExploratoryPool (nullptr),
+		m_BuildSuccessRate (TUNNEL_BUILD_INITIAL_SUCCESS_RATE), m_MeanBuildTime (TUNNEL_BUILD_INITIAL_TIME)
 	{
 	}
 	
 	Tunnels::~Tunnels ()	
 	{
 		for (auto& it : m_OutboundTunnels)
-			delete it;
+			delete it.second;
 		m_OutboundTunnels.clear ();
 
 		for (auto& it : m_InboundTunnels)
@@ -223,26 +239,26 @@ namespace tunnel
 		for (auto& it: m_Pools)
 			delete it;
 		m_Pools.clear ();
+
+		m_NumWorkers = 0;
+		for (auto it: m_Workers)
+			delete it;
+		m_Workers.clear ();
 	}	
 	
 	InboundTunnel * Tunnels::GetInboundTunnel (uint32_t tunnelID)
 	{
-		auto it = m_InboundTunnels.find(tunnelID);
-		if (it != m_InboundTunnels.end ())
-			return it->second;
-		return nullptr;
+		return m_InboundTunnelsTable.Find (tunnelID);
 	}	
 	
 	TransitTunnel * Tunnels::GetTransitTunnel (uint32_t tunnelID)
 	{
-		auto it = m_TransitTunnels.find(tunnelID);
-		if (it != m_TransitTunnels.end ())
-			return it->second;
-		return nullptr;
+		return m_TransitTunnelsTable.Find (tunnelID);
 	}	
 		
 	Tunnel * Tunnels::GetPendingTunnel (uint32_t replyMsgID)
 	{
+		std::unique_lock<std::mutex> l(m_PendingTunnelsMutex);
 		auto it = m_PendingTunnels.find(replyMsgID);
 		if (it != m_PendingTunnels.end () && it->second->GetState () == eTunnelStatePending)
 		{	
@@ -277,9 +293,9 @@ namespace tunnel
 		std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex);
 		for (auto it: m_OutboundTunnels)
 		{	
-			if (it->IsEstablished ())
+			if (it.second->IsEstablished ())
 			{
-				tunnel = it;
+				tunnel = it.second;
 				i++;
 			}
 			if (i > ind && tunnel) break;
@@ -304,9 +320,12 @@ namespace tunnel
 				std::unique_lock<std::mutex> l(m_PoolsMutex);
 				m_Pools.remove (pool);
 			}	
-			for (auto it: m_PendingTunnels)
-				if (it.second->GetTunnelPool () == pool)
-					it.second->SetTunnelPool (nullptr);
+			{
+				std::unique_lock<std::mutex> l(m_PendingTunnelsMutex);
+				for (auto it: m_PendingTunnels)
+					if (it.second->GetTunnelPool () == pool)
+						it.second->SetTunnelPool (nullptr);
+			}	
 			delete pool;
 		}	
 	}	
@@ -324,10 +343,33 @@ namespace tunnel
 	{
 		std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
 		m_TransitTunnels[tunnel->GetTunnelID ()] = tunnel;
+		m_TransitTunnelsTable.Insert (tunnel->GetTunnelID (), tunnel);
+		m_TransitTunnelsExpiration.Schedule (tunnel->GetTunnelID (), tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT + 1);
 	}	
 
 	void Tunnels::Start ()
 	{
+		i2p::crypto::elGamalPairsSupplier.Start (); // for tunnel build records and garlic
+		i2p::StartTunnelBuildWorkers ();
+		StartTunnelGatewaysFlusher (i2p::util::config::GetArg ("-coalescing", 0));
+		transitBandwidthLimiter.SetLimits (i2p::util::config::GetArg ("-inbandwidth", 0),
+			i2p::util::config::GetArg ("-outbandwidth", 0), 
+			i2p::util::config::GetArg ("-share", TRANSIT_BANDWIDTH_DEFAULT_SHARE));
+		if (!m_NumWorkers)
+		{	
+			int numWorkers = i2p::util::config::GetArg ("-tunnelthreads", DEFAULT_NUM_TUNNEL_DATA_WORKERS);
+			if (numWorkers < 1) numWorkers = 1;
+			for (int i = 0; i < numWorkers; i++)
+				m_Workers.push_back (new TunnelDataWorker ());
+			for (auto it: m_Workers)
+				it->Start ();
+			// transports might be running already, they see workers only after this
+			m_NumWorkers.store (m_Workers.size (), std::memory_order_release);
+			LogPrint ("Tunnels: ", numWorkers, " tunnel data workers");
+		}	
+		else	
+			for (auto it: m_Workers)
+				it->Start ();
 		m_IsRunning = true;
 		m_Thread = new std::thread (std::bind (&Tunnels::Run, this));
 	}
@@ -335,55 +377,170 @@ namespace tunnel
 	void Tunnels::Stop ()
 	{
 		m_IsRunning = false;
-		m_Queue.WakeUp ();
 		if (m_Thread)
 		{	
 			m_Thread->join (); 
 			delete m_Thread;
 			m_Thread = 0;
 		}	
+		for (auto it: m_Workers)
+			it->Stop ();
+		StopTunnelGatewaysFlusher ();
+		i2p::StopTunnelBuildWorkers ();
+		i2p::crypto::elGamalPairsSupplier.Stop ();
 	}	
 
 	void Tunnels::Run ()
 	{
 		std::this_thread::sleep_for (std::chrono::seconds(1)); // wait for other parts are ready
 		
-		uint64_t lastTs = 0;
+		uint64_t lastTs = 0, lastEndpointsCleanupTs = 0;
+		while (m_IsRunning)
+		{
+			try
+			{	
+				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+				if (ts - lastTs >= TUNNEL_MANAGE_INTERVAL)
+				{
+					ManageTunnels ();
+					lastTs = ts;
+				}
+				if (ts - lastEndpointsCleanupTs >= TUNNEL_ENDPOINT_CLEANUP_INTERVAL)
+				{
+					CleanupTunnelEndpoints ();
+					lastEndpointsCleanupTs = ts;
+				}
+			}
+			catch (std::exception& ex)
+			{
+				LogPrint ("Tunnels: ", ex.what ());
+			}	
+			std::this_thread::sleep_for (std::chrono::seconds(1));
+		}	
+	}	
+
+	void Tunnels::DeleteTunnel (TunnelBase * tunnel)
+	{
+		if (!m_NumWorkers)
+			delete tunnel; // never started
+		else
+			GetWorker (tunnel->GetTunnelID ())->DeleteTunnel (tunnel);
+	}	
+
+	TunnelDataWorker::TunnelDataWorker (): m_IsRunning (false), m_Thread (nullptr),
+		m_ObservedEpoch (std::numeric_limits<uint64_t>::max ())
+	{
+	}
+	
+	TunnelDataWorker::~TunnelDataWorker ()	
+	{
+		Stop ();
+	}	
+
+	void TunnelDataWorker::Start ()
+	{
+		m_ObservedEpoch = tunnels.GetTablesEpoch ();
+		m_IsRunning = true;
+		m_Thread = new std::thread (std::bind (&TunnelDataWorker::Run, this));
+	}
+	
+	void TunnelDataWorker::Stop ()
+	{
+		m_IsRunning = false;
+		m_Queue.WakeUp ();
+		if (m_Thread)
+		{	
+			m_Thread->join (); 
+			delete m_Thread;
+			m_Thread = 0;
+		}	
+		std::vector<I2NPMessage *> msgs;
+		m_Queue.GetAll (msgs); // not handled anymore
+		for (auto it: msgs)
+			i2p::DeleteI2NPMessage (it);
+		m_ObservedEpoch = std::numeric_limits<uint64_t>::max (); // doesn't read tables anymore
+		DeleteExpiredTunnels ();
+	}	
+
+	void TunnelDataWorker::DeleteTunnel (TunnelBase * tunnel)
+	{
+		std::unique_lock<std::mutex> l(m_ExpiredTunnelsMutex);
+		m_ExpiredTunnels.push_back (tunnel);
+	}	
+
+	void TunnelDataWorker::DeleteExpiredTunnels ()
+	{
+		std::vector<TunnelBase *> expiredTunnels;
+		{
+			std::unique_lock<std::mutex> l(m_ExpiredTunnelsMutex);
+			if (m_ExpiredTunnels.empty ()) return;
+			m_ExpiredTunnels.swap (expiredTunnels);
+		}
+		for (auto it: expiredTunnels)
+			delete it;
+	}	
+
+	void TunnelDataWorker::Run ()
+	{
+		TransitTunnel * transitTunnels[TRANSIT_TUNNEL_BATCH_SIZE]; 
+		I2NPMessage * transitMsgs[TRANSIT_TUNNEL_BATCH_SIZE]; 
+		int numTransitMsgs = 0;
+		std::vector<I2NPMessage *> msgs;
 		while (m_IsRunning)
 		{
 			try
 			{	
-				I2NPMessage * msg = m_Queue.GetNextWithTimeout (1000); // 1 sec
-				while (msg)
+				msgs.clear ();
+				m_Queue.GetAllWithTimeout (msgs, 1000); // 1 sec
+				for (size_t i = 0; i < msgs.size (); i++)
 				{
-					uint32_t  tunnelID = be32toh (*(uint32_t *)msg->GetPayload ()); 
-					InboundTunnel * tunnel = GetInboundTunnel (tunnelID);
-					if (tunnel)
-						tunnel->HandleTunnelDataMsg (msg);
+					I2NPMessage * msg = msgs[i];
+					if (msg->GetHeader ()->typeID == eI2NPTunnelGateway)
+						i2p::HandleTunnelGatewayMsg (msg);
 					else
 					{	
-						TransitTunnel * transitTunnel = GetTransitTunnel (tunnelID);
-						if (transitTunnel)
-							transitTunnel->HandleTunnelDataMsg (msg);
-						else	
+						uint32_t  tunnelID = be32toh (*(uint32_t *)msg->GetPayload ()); 
+						InboundTunnel * tunnel = tunnels.GetInboundTunnel (tunnelID);
+						if (tunnel)
+							tunnel->HandleTunnelDataMsg (msg);
+						else
 						{	
-							LogPrint ("Tunnel ", tunnelID, " not found");
-							i2p::DeleteI2NPMessage (msg);
+							TransitTunnel * transitTunnel = tunnels.GetTransitTunnel (tunnelID);
+							if (transitTunnel && !transitBandwidthLimiter.Accept (msg->GetLength ()))
+							{
+								LogPrint ("Transit bandwidth exceeded. Message for tunnel ", tunnelID, " dropped");
+								i2p::DeleteI2NPMessage (msg);
+							}	
+							else if (transitTunnel)
+							{
+								// collect for encryption in lockstep
+								transitTunnels[numTransitMsgs] = transitTunnel;
+								transitMsgs[numTransitMsgs] = msg;
+								numTransitMsgs++;
+							}	
+							else	
+							{	
+								LogPrint ("Tunnel ", tunnelID, " not found");
+								i2p::DeleteI2NPMessage (msg);
+							}	
 						}	
 					}	
-					msg = m_Queue.Get ();
+					if (numTransitMsgs >= TRANSIT_TUNNEL_BATCH_SIZE || (i + 1 == msgs.size () && numTransitMsgs > 0))
+					{
+						int num = numTransitMsgs;
+						numTransitMsgs = 0;
+						TransitTunnel::EncryptTunnelMsgs (num, transitTunnels, transitMsgs);
+						for (int i = 0; i < num; i++)
+							transitTunnels[i]->HandleEncryptedTunnelDataMsg (transitMsgs[i]);
+					}	
 				}	
-			
-				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
-				if (ts - lastTs >= 15) // manage tunnels every 15 seconds
-				{
-					ManageTunnels ();
-					lastTs = ts;
-				}
+				// quiescent state, none of our tunnels or tunnels tables is in use here
+				m_ObservedEpoch = tunnels.GetTablesEpoch ();
+				DeleteExpiredTunnels ();
 			}
 			catch (std::exception& ex)
 			{
-				LogPrint ("Tunnels: ", ex.what ());
+				LogPrint ("Tunnel data worker: ", ex.what ());
 			}	
 		}	
 	}	
@@ -395,12 +552,33 @@ namespace tunnel
 		ManageOutboundTunnels ();
 		ManageTransitTunnels ();
 		ManageTunnelPools ();
+		ReclaimTables ();
+	}
+
+	void Tunnels::ReclaimTables ()
+	{
+		// tables replaced before every worker has passed quiescent state are still in use
+		uint64_t observedEpoch = std::numeric_limits<uint64_t>::max ();
+		for (auto it: m_Workers)
+		{
+			auto epoch = it->GetObservedEpoch ();
+			if (epoch < observedEpoch) observedEpoch = epoch;
+		}	
+		{
+			std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
+			m_InboundTunnelsTable.Reclaim (observedEpoch);
+		}
+		{
+			std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
+			m_TransitTunnelsTable.Reclaim (observedEpoch);
+		}
 	}	
 
 	void Tunnels::ManagePendingTunnels ()
 	{
 		// check pending tunnel. delete failed or timeout
 		uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+		std::unique_lock<std::mutex> l(m_PendingTunnelsMutex);
 		for (auto it = m_PendingTunnels.begin (); it != m_PendingTunnels.end ();)
 		{	
 			auto tunnel = it->second;
@@ -410,6 +588,10 @@ namespace tunnel
 					if (ts > tunnel->GetCreationTime () + TUNNEL_CREATION_TIMEOUT)
 					{
 						LogPrint ("Pending tunnel build request ", it->first, " timeout. Deleted");
+						// we don't know which hop has dropped it
+						for (auto hop = tunnel->GetTunnelConfig ()->GetFirstHop (); hop; hop = hop->next)
+							i2p::data::profiles.TunnelBuildTimeout (hop->router->GetIdentHash ());
+						TunnelBuildFailed ();
 						delete tunnel;
 						it = m_PendingTunnels.erase (it);
 					}
@@ -418,6 +600,7 @@ namespace tunnel
 				break;
 				case eTunnelStateBuildFailed:
 					LogPrint ("Pending tunnel build request ", it->first, " failed. Deleted");
+					TunnelBuildFailed ();
 					delete tunnel;
 					it = m_PendingTunnels.erase (it);
 				break;
@@ -433,36 +616,41 @@ namespace tunnel
 
 	void Tunnels::ManageOutboundTunnels ()
 	{
-		uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
+		std::vector<uint32_t> tunnelIDs;
 		{
-			for (auto it = m_OutboundTunnels.begin (); it != m_OutboundTunnels.end ();)
+			std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex);
+			m_OutboundTunnelsExpiration.Advance (ts, tunnelIDs);
+		}	
+		for (auto tunnelID: tunnelIDs)
+		{
+			OutboundTunnel * tunnel;
 			{
-				auto tunnel = *it;
-				if (ts > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+				std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex); // added by other threads
+				auto it = m_OutboundTunnels.find (tunnelID);
+				if (it == m_OutboundTunnels.end ()) continue; // deleted by previous event if expired
+				tunnel = it->second;
+			}	
+			if (ts > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+			{
+				LogPrint ("Tunnel ", tunnel->GetTunnelID (), " expired");
 				{
-					LogPrint ("Tunnel ", tunnel->GetTunnelID (), " expired");
-					{
-						std::unique_lock<std::mutex> l(m_PoolsMutex);
-						auto pool = tunnel->GetTunnelPool ();
-						if (pool)
-							pool->TunnelExpired (tunnel);
-					}	
-					{
-						std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex);
-						it = m_OutboundTunnels.erase (it);
-					}
-					delete tunnel;
+					std::unique_lock<std::mutex> l(m_PoolsMutex);
+					auto pool = tunnel->GetTunnelPool ();
+					if (pool)
+						pool->TunnelExpired (tunnel);
 				}	
-				else 
 				{
-					if (tunnel->IsEstablished () && ts + TUNNEL_EXPIRATION_THRESHOLD > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
-						tunnel->SetState (eTunnelStateExpiring);
-					it++;
+					std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex);
+					m_OutboundTunnels.erase (tunnelID);
 				}
-			}
+				DeleteTunnel (tunnel); // gateway might be used by other threads yet
+			}	
+			else if (tunnel->IsEstablished () && ts + TUNNEL_EXPIRATION_THRESHOLD > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+				tunnel->SetState (eTunnelStateExpiring);
 		}	
 	
-		if (m_OutboundTunnels.size () < 5) 
+		if (m_OutboundTunnels.size () < 5 && GetNumPendingTunnels () < MAX_NUM_PENDING_TUNNEL_BUILDS) 
 		{
 			// trying to create one more oubound tunnel
 			InboundTunnel * inboundTunnel = GetNextInboundTunnel ();
@@ -479,33 +667,35 @@ namespace tunnel
 	
 	void Tunnels::ManageInboundTunnels ()
 	{
-		uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
+		std::vector<uint32_t> tunnelIDs;
 		{
-			for (auto it = m_InboundTunnels.begin (); it != m_InboundTunnels.end ();)
+			std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
+			m_InboundTunnelsExpiration.Advance (ts, tunnelIDs);
+		}	
+		for (auto tunnelID: tunnelIDs)
+		{
+			auto it = m_InboundTunnels.find (tunnelID);
+			if (it == m_InboundTunnels.end ()) continue; // deleted by previous event if expired
+			auto tunnel = it->second;
+			if (ts > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
 			{
-				auto tunnel = it->second;
-				if (ts > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+				LogPrint ("Tunnel ", tunnel->GetTunnelID (), " expired");
 				{
-					LogPrint ("Tunnel ", tunnel->GetTunnelID (), " expired");
-					{
-						std::unique_lock<std::mutex> l(m_PoolsMutex);
-						auto pool = tunnel->GetTunnelPool ();
-						if (pool)
-							pool->TunnelExpired (tunnel);
-					}	
-					{
-						std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
-						it = m_InboundTunnels.erase (it);
-					}
-					delete tunnel;
+					std::unique_lock<std::mutex> l(m_PoolsMutex);
+					auto pool = tunnel->GetTunnelPool ();
+					if (pool)
+						pool->TunnelExpired (tunnel);
 				}	
-				else 
 				{
-					if (tunnel->IsEstablished () && ts + TUNNEL_EXPIRATION_THRESHOLD > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
-						tunnel->SetState (eTunnelStateExpiring);
-					it++;
+					std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
+					m_InboundTunnelsTable.Remove (tunnelID);
+					m_InboundTunnels.erase (it);
 				}
-			}
+				DeleteTunnel (tunnel);
+			}	
+			else if (tunnel->IsEstablished () && ts + TUNNEL_EXPIRATION_THRESHOLD > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+				tunnel->SetState (eTunnelStateExpiring);
 		}	
 
 		if (m_InboundTunnels.empty ())
@@ -517,7 +707,8 @@ namespace tunnel
 			return;
 		}
 		
-		if (m_OutboundTunnels.empty () || m_InboundTunnels.size () < 5) 
+		if ((m_OutboundTunnels.empty () || m_InboundTunnels.size () < 5) && 
+			GetNumPendingTunnels () < MAX_NUM_PENDING_TUNNEL_BUILDS) 
 		{
 			// trying to create one more inbound tunnel			
 			LogPrint ("Creating one hop inbound tunnel...");
@@ -532,40 +723,102 @@ namespace tunnel
 	void Tunnels::ManageTransitTunnels ()
 	{
 		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-		for (auto it = m_TransitTunnels.begin (); it != m_TransitTunnels.end ();)
+		std::vector<uint32_t> tunnelIDs;
+		std::vector<TransitTunnel *> expiredTunnels;
 		{
-			if (ts > it->second->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+			std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
+			m_TransitTunnelsExpiration.Advance (ts, tunnelIDs);
+			for (auto tunnelID: tunnelIDs)
 			{
-				LogPrint ("Transit tunnel ", it->second->GetTunnelID (), " expired");
-				auto tmp = it->second;
+				auto it = m_TransitTunnels.find (tunnelID);
+				// tunnel ID might be reused by newer tunnel
+				if (it != m_TransitTunnels.end () && ts > it->second->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
 				{
-					std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
-					it = m_TransitTunnels.erase (it);
+					expiredTunnels.push_back (it->second);
+					m_TransitTunnelsTable.Remove (tunnelID);
+					m_TransitTunnels.erase (it);
 				}	
-				delete tmp;
 			}	
-			else 
-				it++;
-		}
+		}	
+		for (auto tunnel: expiredTunnels)
+		{
+			LogPrint ("Transit tunnel ", tunnel->GetTunnelID (), " expired");
+			DeleteTunnel (tunnel);
+		}	
+		transitBandwidthLimiter.UpdateRates (m_TransitTunnels.size ());
 	}	
 
 	void Tunnels::ManageTunnelPools ()
 	{
+		// builds in progress by pool, inbound and outbound
+		std::map<TunnelPool *, std::pair<int, int> > numPendingTunnels;
+		{
+			std::unique_lock<std::mutex> l(m_PendingTunnelsMutex);
+			for (auto it: m_PendingTunnels)
+			{
+				auto state = it.second->GetState ();
+				auto pool = it.second->GetTunnelPool ();
+				if (pool && (state == eTunnelStatePending || state == eTunnelStateBuildReplyReceived))
+				{
+					if (it.second->IsInbound ())
+						numPendingTunnels[pool].first++;
+					else
+						numPendingTunnels[pool].second++;
+				}	
+			}	
+		}	
 		std::unique_lock<std::mutex> l(m_PoolsMutex);
 		for (auto it: m_Pools)
 		{	
 			TunnelPool * pool = it;
 			if (pool->IsActive ())
 			{	
-				pool->CreateTunnels ();
+				auto& numPending = numPendingTunnels[pool];
+				pool->CreateTunnels (numPending.first, numPending.second);
 				pool->TestTunnels ();
 			}		
 		}
 	}	
+
+	int Tunnels::GetNumPendingTunnels () const
+	{
+		std::unique_lock<std::mutex> l(m_PendingTunnelsMutex);
+		return m_PendingTunnels.size ();
+	}	
+
+	int Tunnels::GetRebuildLeadTime () const
+	{
+		// replacement should be established before old tunnel becomes expiring, 
+		// failed attempt might cost creation timeout
+		int leadTime = TUNNEL_EXPIRATION_THRESHOLD + TUNNEL_MANAGE_INTERVAL + m_MeanBuildTime/1000 + 
+			(1000 - m_BuildSuccessRate)*TUNNEL_CREATION_TIMEOUT/1000;
+		if (leadTime > TUNNEL_EXPIRATION_TIMEOUT/2) leadTime = TUNNEL_EXPIRATION_TIMEOUT/2;
+		return leadTime;
+	}	
+
+	void Tunnels::TunnelBuildSucceeded (Tunnel * tunnel)
+	{
+		int buildTime = i2p::util::GetMillisecondsSinceEpoch () - tunnel->GetBuildStartTime ();
+		if (buildTime < 0 || buildTime > TUNNEL_CREATION_TIMEOUT*1000) buildTime = TUNNEL_CREATION_TIMEOUT*1000; 
+		m_MeanBuildTime += (buildTime - m_MeanBuildTime)/TUNNEL_BUILD_STATS_EWMA_WEIGHT;
+		m_BuildSuccessRate += (1000 - m_BuildSuccessRate)/TUNNEL_BUILD_STATS_EWMA_WEIGHT;
+	}	
+
+	void Tunnels::TunnelBuildFailed ()
+	{
+		m_BuildSuccessRate -= m_BuildSuccessRate/TUNNEL_BUILD_STATS_EWMA_WEIGHT;
+	}	
 	
 	void Tunnels::PostTunnelData (I2NPMessage * msg)
 	{
-		if (msg) m_Queue.Put (msg);		
+		if (!msg) return;
+		auto worker = GetWorker (be32toh (*(uint32_t *)msg->GetPayload ())); // same offset for TunnelGateway
+		if (!worker) // not started yet
+		{
+			i2p::DeleteI2NPMessage (msg);
+			return;
+		}	
+		worker->PostTunnelData (msg);	
 	}	
 
 	template<class TTunnel>
@@ -573,7 +826,10 @@ namespace tunnel
 	{
 		TTunnel * newTunnel = new TTunnel (config);
 		uint32_t replyMsgID = i2p::context.GetRandomNumberGenerator ().GenerateWord32 ();
-		m_PendingTunnels[replyMsgID] = newTunnel; 
+		{
+			std::unique_lock<std::mutex> l(m_PendingTunnelsMutex);
+			m_PendingTunnels[replyMsgID] = newTunnel; 
+		}	
 		newTunnel->Build (replyMsgID, outboundTunnel);
 		return newTunnel;
 	}	
@@ -581,7 +837,9 @@ namespace tunnel
 	void Tunnels::AddOutboundTunnel (OutboundTunnel * newTunnel)
 	{
 		std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex);
-		m_OutboundTunnels.push_back (newTunnel);
+		m_OutboundTunnels[newTunnel->GetTunnelID ()] = newTunnel;
+		TunnelBuildSucceeded (newTunnel);
+		ScheduleExpiration (m_OutboundTunnelsExpiration, newTunnel->GetTunnelID (), newTunnel->GetCreationTime ());
 		auto pool = newTunnel->GetTunnelPool ();
 		if (pool && pool->IsActive ())
 			pool->TunnelCreated (newTunnel);
@@ -593,6 +851,9 @@ namespace tunnel
 	{
 		std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
 		m_InboundTunnels[newTunnel->GetTunnelID ()] = newTunnel;
+		m_InboundTunnelsTable.Insert (newTunnel->GetTunnelID (), newTunnel);
+		TunnelBuildSucceeded (newTunnel);
+		ScheduleExpiration (m_InboundTunnelsExpiration, newTunnel->GetTunnelID (), newTunnel->GetCreationTime ());
 		auto pool = newTunnel->GetTunnelPool ();
 		if (!pool)
 		{		
@@ -609,6 +870,13 @@ namespace tunnel
 	}	
 
 	
+	void Tunnels::ScheduleExpiration (i2p::util::TimingWheel<uint32_t>& expiration, uint32_t tunnelID, uint32_t creationTime)
+	{
+		// checked twice, to set expiring state and to delete
+		expiration.Schedule (tunnelID, creationTime + TUNNEL_EXPIRATION_TIMEOUT - TUNNEL_EXPIRATION_THRESHOLD + 1);
+		expiration.Schedule (tunnelID, creationTime + TUNNEL_EXPIRATION_TIMEOUT + 1);
+	}	
+
 	void Tunnels::CreateZeroHopsInboundTunnel ()
 	{
 		CreateTunnel<InboundTunnel> (
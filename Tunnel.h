@@ -8,6 +8,7 @@
 #include <string>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include "Queue.h"
 #include "TunnelConfig.h"
 #include "TunnelPool.h"
@@ -15,6 +16,8 @@
 #include "TunnelEndpoint.h"
 #include "TunnelGateway.h"
 #include "TunnelBase.h"
+#include "TunnelsTable.h"
+#include "TimingWheel.h"
 #include "I2NPProtocol.h"
 
 namespace i2p
@@ -25,6 +28,14 @@ namespace tunnel
 	const int TUNNEL_EXPIRATION_THRESHOLD = 60; // 1 minute	
 	const int TUNNEL_CREATION_TIMEOUT = 30; // 30 seconds
 	const int STANDARD_NUM_RECORDS = 5; // in VariableTunnelBuild message
+	const int DEFAULT_NUM_TUNNEL_DATA_WORKERS = 2; // overridden by --tunnelthreads
+	const int TUNNEL_LATENCY_EWMA_WEIGHT = 4; // new test sample counts as 1/4
+	const int TUNNEL_MANAGE_INTERVAL = 15; // in seconds
+	const int TUNNEL_BUILD_STATS_EWMA_WEIGHT = 16;
+	const int TUNNEL_BUILD_INITIAL_SUCCESS_RATE = 500; // per mille, until observed
+	const int TUNNEL_BUILD_MIN_SUCCESS_RATE = 100; // per mille, limits number of parallel builds
+	const int TUNNEL_BUILD_INITIAL_TIME = 5000; // milliseconds, until observed
+	const int MAX_NUM_PENDING_TUNNEL_BUILDS = 50; // all pools together
 
 	enum TunnelState
 	{
@@ -53,11 +64,16 @@ namespace tunnel
 			void SetState (TunnelState state)  { m_State = state; };
 			bool IsEstablished () const { return m_State == eTunnelStateEstablished; };
 			bool IsFailed () const { return m_State == eTunnelStateFailed; };
+			virtual bool IsInbound () const = 0;
+			uint64_t GetBuildStartTime () const { return m_BuildStartTime; }; // milliseconds since epoch
 
 			TunnelPool * GetTunnelPool () const { return m_Pool; };
 			void SetTunnelPool (TunnelPool * pool) { m_Pool = pool; };			
 			
 			bool HandleTunnelBuildResponse (uint8_t * msg, size_t len);
+
+			void AddLatencySample (int latency); // round trip of tunnel test in milliseconds
+			int GetMeanLatency () const { return m_Latency; }; // 0 if not tested yet
 			
 			// implements TunnelBase
 			void EncryptTunnelMsg (I2NPMessage * tunnelMsg); 
@@ -69,6 +85,8 @@ namespace tunnel
 			TunnelConfig * m_Config;
 			TunnelPool * m_Pool; // pool, tunnel belongs to, or null
 			TunnelState m_State;
+			int m_Latency; // EWMA
+			uint64_t m_BuildStartTime;
 	};	
 
 	class OutboundTunnel: public Tunnel 
@@ -82,13 +100,13 @@ namespace tunnel
 			std::shared_ptr<const i2p::data::RouterInfo> GetEndpointRouter () const 
 				{ return GetTunnelConfig ()->GetLastHop ()->router; }; 
 			size_t GetNumSentBytes () const { return m_Gateway.GetNumSentBytes (); };
+			bool IsInbound () const { return false; };
 
 			// implements TunnelBase
 			uint32_t GetTunnelID () const { return GetNextTunnelID (); };
 			
 		private:
 
-			std::mutex m_SendMutex;
 			TunnelGateway m_Gateway; 
 	};
 	
@@ -99,6 +117,7 @@ namespace tunnel
 			InboundTunnel (TunnelConfig * config): Tunnel (config), m_Endpoint (true) {};
 			void HandleTunnelDataMsg (I2NPMessage * msg);
 			size_t GetNumReceivedBytes () const { return m_Endpoint.GetNumReceivedBytes (); };
+			bool IsInbound () const { return true; };
 
 			// implements TunnelBase
 			uint32_t GetTunnelID () const { return GetTunnelConfig ()->GetLastHop ()->nextTunnelID; };
@@ -107,6 +126,34 @@ namespace tunnel
 			TunnelEndpoint m_Endpoint; 
 	};	
 
+
+	class TunnelDataWorker // handles tunnel data and gateway messages of tunnels it owns
+	{
+		public:
+
+			TunnelDataWorker ();
+			~TunnelDataWorker ();
+			void Start ();
+			void Stop ();		
+
+			void PostTunnelData (I2NPMessage * msg) { m_Queue.Put (msg); };
+			void DeleteTunnel (TunnelBase * tunnel); // expired, deleted by worker when not in use
+			uint64_t GetObservedEpoch () const { return m_ObservedEpoch; }; // of tunnels tables
+
+		private:
+
+			void Run ();
+			void DeleteExpiredTunnels ();
+
+		private:
+
+			bool m_IsRunning;
+			std::thread * m_Thread;	
+			i2p::util::MPSCQueue<I2NPMessage> m_Queue;
+			std::mutex m_ExpiredTunnelsMutex;
+			std::vector<TunnelBase *> m_ExpiredTunnels;
+			std::atomic<uint64_t> m_ObservedEpoch; // at last quiescent state, max if stopped
+	};	
 	
 	class Tunnels
 	{	
@@ -117,21 +164,28 @@ namespace tunnel
 			void Start ();
 			void Stop ();		
 			
-			InboundTunnel * GetInboundTunnel (uint32_t tunnelID);
+			InboundTunnel * GetInboundTunnel (uint32_t tunnelID); // lock-free, from tunnel data workers only
 			Tunnel * GetPendingTunnel (uint32_t replyMsgID);
 			InboundTunnel * GetNextInboundTunnel ();
 			OutboundTunnel * GetNextOutboundTunnel ();
 			TunnelPool * GetExploratoryPool () const { return m_ExploratoryPool; };
-			TransitTunnel * GetTransitTunnel (uint32_t tunnelID);
+			TransitTunnel * GetTransitTunnel (uint32_t tunnelID); // lock-free, from tunnel data workers only
 			void AddTransitTunnel (TransitTunnel * tunnel);
 			void AddOutboundTunnel (OutboundTunnel * newTunnel);
 			void AddInboundTunnel (InboundTunnel * newTunnel);
 			void PostTunnelData (I2NPMessage * msg);
+			uint64_t GetTablesEpoch () const { return m_TablesEpoch; };
 			template<class TTunnel>
 			TTunnel * CreateTunnel (TunnelConfig * config, OutboundTunnel * outboundTunnel = 0);
 			TunnelPool * CreateTunnelPool (i2p::garlic::GarlicDestination& localDestination, int numInboundHops, int numOuboundHops);
 			void DeleteTunnelPool (TunnelPool * pool);
 			void StopTunnelPool (TunnelPool * pool);
+
+			// for rebuild scheduling
+			int GetNumPendingTunnels () const;
+			int GetBuildSuccessRate () const { return m_BuildSuccessRate; }; // per mille, EWMA
+			int GetMeanBuildTime () const { return m_MeanBuildTime; }; // milliseconds, EWMA
+			int GetRebuildLeadTime () const; // seconds before expiration to start replacement
 			
 		private:
 			
@@ -142,24 +196,45 @@ namespace tunnel
 			void ManageTransitTunnels ();
 			void ManagePendingTunnels ();
 			void ManageTunnelPools ();
+			void TunnelBuildSucceeded (Tunnel * tunnel);
+			void TunnelBuildFailed ();
 			
+			void ScheduleExpiration (i2p::util::TimingWheel<uint32_t>& expiration, uint32_t tunnelID, uint32_t creationTime);
 			void CreateZeroHopsInboundTunnel ();
+			TunnelDataWorker * GetWorker (uint32_t tunnelID) const // tunnel is owned by exactly one worker, null if not started
+			{ 
+				size_t numWorkers = m_NumWorkers.load (std::memory_order_acquire);
+				return numWorkers ? m_Workers[tunnelID % numWorkers] : nullptr; 
+			};
+			void DeleteTunnel (TunnelBase * tunnel);
+			void ReclaimTables ();
 			
 		private:
 
 			bool m_IsRunning;
-			std::thread * m_Thread;	
+			std::thread * m_Thread;	// housekeeping
+			std::vector<TunnelDataWorker *> m_Workers; // not changed once published
+			std::atomic<size_t> m_NumWorkers; // published after workers are created
+			mutable std::mutex m_PendingTunnelsMutex; // replies are handled by build workers
 			std::map<uint32_t, Tunnel *> m_PendingTunnels; // by replyMsgID
 			std::mutex m_InboundTunnelsMutex;
 			std::map<uint32_t, InboundTunnel *> m_InboundTunnels;
 			std::mutex m_OutboundTunnelsMutex;
-			std::list<OutboundTunnel *> m_OutboundTunnels;
+			std::map<uint32_t, OutboundTunnel *> m_OutboundTunnels;
 			std::mutex m_TransitTunnelsMutex;
 			std::map<uint32_t, TransitTunnel *> m_TransitTunnels;
+			// copies of maps above for lookups, modified under the same mutexes
+			std::atomic<uint64_t> m_TablesEpoch;
+			TunnelsTable<InboundTunnel> m_InboundTunnelsTable;
+			TunnelsTable<TransitTunnel> m_TransitTunnelsTable;
+			// expiring and expiration events, modified under the same mutexes
+			i2p::util::TimingWheel<uint32_t> m_InboundTunnelsExpiration; // by tunnel ID
+			i2p::util::TimingWheel<uint32_t> m_OutboundTunnelsExpiration;
+			i2p::util::TimingWheel<uint32_t> m_TransitTunnelsExpiration; // by tunnel ID
 			std::mutex m_PoolsMutex;
 			std::list<TunnelPool *> m_Pools;
 			TunnelPool * m_ExploratoryPool;
-			i2p::util::Queue<I2NPMessage> m_Queue;
+			std::atomic<int> m_BuildSuccessRate, m_MeanBuildTime;
 
 		public:
 
@@ -1,5 +1,8 @@
 #include "I2PEndian.h"
 #include <string.h>
+#include <atomic>
+#include <set>
+#include "sha256.h"
 #include "Log.h"
 #include "NetDb.h"
 #include "I2NPProtocol.h"
@@ -11,18 +14,56 @@ namespace i2p
 {
 namespace tunnel
 {
+	static std::atomic<size_t> numIncompleteMessages (0), reassemblyMemory (0), 
+		numExpiredMessages (0), numEvictedMessages (0), numDroppedFragments (0);
+
+	// all endpoints, for housekeeping, idle ones don't clean up themselves
+	static std::mutex endpointsMutex;
+	static std::set<TunnelEndpoint *> endpoints;
+	static std::atomic<size_t> numEndpoints (0);
+
+	static size_t GetFairShare ()
+	{
+		size_t num = numEndpoints;
+		return num ? TUNNEL_ENDPOINT_MAX_REASSEMBLY_MEMORY/num : TUNNEL_ENDPOINT_MAX_REASSEMBLY_MEMORY;
+	}	
+
+	TunnelEndpointStats GetTunnelEndpointStats ()
+	{
+		return TunnelEndpointStats { numIncompleteMessages, reassemblyMemory, 
+			numExpiredMessages, numEvictedMessages, numDroppedFragments };
+	}	
+
+	void CleanupTunnelEndpoints ()
+	{
+		std::unique_lock<std::mutex> l(endpointsMutex);
+		size_t fairShare = GetFairShare ();
+		for (auto it: endpoints)
+			it->CleanupIncompleteMessages (fairShare);
+	}	
+
+	TunnelEndpoint::TunnelEndpoint (bool isInbound): m_ReassemblyMemory (0), m_IsInbound (isInbound), 
+		m_NumReceivedBytes (0)
+	{
+		std::unique_lock<std::mutex> l(endpointsMutex);
+		endpoints.insert (this);
+		numEndpoints++;
+	}
+		
 	TunnelEndpoint::~TunnelEndpoint ()
 	{
-		for (auto it: m_IncompleteMessages)
-			i2p::DeleteI2NPMessage (it.second.data);
-		for (auto it: m_OutOfSequenceFragments)
-			i2p::DeleteI2NPMessage (it.second.data);
+		{
+			std::unique_lock<std::mutex> l(endpointsMutex);
+			endpoints.erase (this);
+			numEndpoints--;
+		}	
+		while (!m_IncompleteMessages.empty ())
+			DeleteIncompleteMessage (m_IncompleteMessages.begin ());
 	}	
 	
 	void TunnelEndpoint::HandleDecryptedTunnelDataMsg (I2NPMessage * msg)
 	{
 		m_NumReceivedBytes += TUNNEL_DATA_MSG_SIZE;
-		
 		uint8_t * decrypted = msg->GetPayload () + 20; // 4 + 16
 		uint8_t * zero = (uint8_t *)memchr (decrypted + 4, 0, TUNNEL_DATA_ENCRYPTED_SIZE - 4); // witout 4-byte checksum
 		if (zero)
@@ -32,7 +73,7 @@ namespace tunnel
 			// verify checksum
 			memcpy (msg->GetPayload () + TUNNEL_DATA_MSG_SIZE, msg->GetPayload () + 4, 16); // copy iv to the end
 			uint8_t hash[32];
-			CryptoPP::SHA256().CalculateDigest (hash, fragment, TUNNEL_DATA_MSG_SIZE -(fragment - msg->GetPayload ()) + 16); // payload + iv
+			i2p::crypto::SHA256 (fragment, TUNNEL_DATA_MSG_SIZE -(fragment - msg->GetPayload ()) + 16, hash); // payload + iv
 			if (memcmp (hash, decrypted, 4))
 			{
 				LogPrint ("TunnelMessage: checksum verification failed");
@@ -40,6 +81,7 @@ namespace tunnel
 				return;
 			}	
 			// process fragments
+			bool isMsgUsed = false; 
 			while (fragment < decrypted + TUNNEL_DATA_ENCRYPTED_SIZE)
 			{
 				uint8_t flag = fragment[0];
@@ -48,7 +90,7 @@ namespace tunnel
 				bool isFollowOnFragment = flag & 0x80, isLastFragment = true;		
 				uint32_t msgID = 0;
 				int fragmentNum = 0;
-				TunnelMessageBlockEx m;
+				TunnelMessageBlock m;
 				if (!isFollowOnFragment)
 				{	
 					// first fragment
@@ -98,45 +140,43 @@ namespace tunnel
 				uint16_t size = be16toh (*(uint16_t *)fragment);
 				fragment += 2;
 				LogPrint ("Fragment size=", (int)size);
-
-				msg->offset = fragment - msg->buf;
-				msg->len = msg->offset + size;
-				if (fragment + size < decrypted + TUNNEL_DATA_ENCRYPTED_SIZE)
+				if (fragment + size > decrypted + TUNNEL_DATA_ENCRYPTED_SIZE)
 				{
-					// this is not last message. we have to copy it
-					m.data = NewI2NPMessage ();
-					m.data->offset += sizeof (TunnelGatewayHeader); // reserve room for TunnelGateway header
-					m.data->len += sizeof (TunnelGatewayHeader);
-					*(m.data) = *msg;
-				}
-				else
-					m.data = msg;
+					LogPrint ("Fragment size ", (int)size, " exceeds tunnel message. Dropped");
+					numDroppedFragments++;
+					break;
+				}	
 				
 				if (!isFollowOnFragment && isLastFragment)
+				{
+					msg->offset = fragment - msg->buf;
+					msg->len = msg->offset + size;
+					if (fragment + size < decrypted + TUNNEL_DATA_ENCRYPTED_SIZE)
+					{
+						// this is not last message. we have to copy it
+						m.data = NewI2NPMessage (); // has headroom for TunnelGateway header
+						*(m.data) = *msg;
+					}
+					else
+					{	
+						m.data = msg;
+						isMsgUsed = true;
+					}	
 					HandleNextMessage (m);
+				}	
 				else
 				{
 					if (msgID) // msgID is presented, assume message is fragmented
-					{
-						if (!isFollowOnFragment) // create new incomlete message
-						{
-							m.nextFragmentNum = 1;
-							auto& msg = m_IncompleteMessages[msgID];
-							msg = m;
-							HandleOutOfSequenceFragment (msgID, msg);
-						}
-						else
-						{
-							m.nextFragmentNum = fragmentNum;
-							HandleFollowOnFragment (msgID, isLastFragment, m);
-						}	
-					}
+						// copied to reassembly buffer
+						HandleFragment (msgID, fragmentNum, isLastFragment, isFollowOnFragment ? nullptr : &m, fragment, size);
 					else
 						LogPrint ("Message is fragmented, but msgID is not presented");
 				}	
 					
 				fragment += size;
 			}	
+			if (!isMsgUsed)
+				i2p::DeleteI2NPMessage (msg);
 		}	
 		else
 		{	
@@ -145,85 +185,184 @@ namespace tunnel
 		}	
 	}	
 
-	void TunnelEndpoint::HandleFollowOnFragment (uint32_t msgID, bool isLastFragment, const TunnelMessageBlockEx& m)
+	void TunnelEndpoint::HandleFragment (uint32_t msgID, int fragmentNum, bool isLastFragment, 
+		const TunnelMessageBlock * firstFragment, const uint8_t * fragment, size_t size)
 	{
-		auto fragment = m.data->GetBuffer ();
-		auto size = m.data->GetLength ();
+		if (fragmentNum >= TUNNEL_MAX_NUM_FRAGMENTS || size > TUNNEL_FRAGMENT_MAX_SIZE)
+		{
+			LogPrint ("Malformed fragment ", fragmentNum, " of message ", msgID, ". Dropped");
+			numDroppedFragments++;
+			return;
+		}	
+		std::unique_lock<std::mutex> l(m_IncompleteMessagesMutex);
 		auto it = m_IncompleteMessages.find (msgID);
-		if (it != m_IncompleteMessages.end())
+		if (it == m_IncompleteMessages.end ())
+			it = CreateIncompleteMessage (msgID);
+		auto& msg = it->second;
+		uint64_t mask = 1ULL << fragmentNum;
+		if (msg.receivedFragments & mask)
+		{
+			LogPrint ("Duplicate fragment ", fragmentNum, " of message ", msgID, ". Dropped");
+			numDroppedFragments++;
+			return;
+		}	
+		if (msg.totalLen + size > I2NP_MAX_MESSAGE_SIZE - I2NP_HEADROOM)
+		{
+			LogPrint ("Fragment ", fragmentNum, " of message ", msgID, " exceeds max I2NP message size. Message dropped");
+			numDroppedFragments++;
+			DeleteIncompleteMessage (it);
+			return;
+		}	
+		bool inSequence = fragmentNum == msg.nextFragmentNum;
+		size_t offset = inSequence ? msg.contiguousLen : fragmentNum*TUNNEL_FRAGMENT_MAX_SIZE;
+		if (!ReserveBuffer (msgID, msg, offset + size))
+		{
+			LogPrint ("No room for fragment ", fragmentNum, " of message ", msgID, ". Message dropped");
+			numDroppedFragments++;
+			DeleteIncompleteMessage (it);
+			return;
+		}	
+		uint8_t * buf = msg.block.data->GetBuffer ();
+		memcpy (buf + offset, fragment, size);
+		msg.fragmentSizes[fragmentNum] = size;
+		msg.receivedFragments |= mask;
+		msg.totalLen += size;
+		if (inSequence)
 		{
-			auto& msg = it->second;
-			if (m.nextFragmentNum == msg.nextFragmentNum)
+			// append, then fragments received out of sequence that follow
+			msg.contiguousLen += size;
+			msg.nextFragmentNum++;
+			while (msg.nextFragmentNum < TUNNEL_MAX_NUM_FRAGMENTS && (msg.receivedFragments & (1ULL << msg.nextFragmentNum)))
 			{
-				if (msg.data->len + size < I2NP_MAX_MESSAGE_SIZE) // check if messega is not too long
-				{	
-					memcpy (msg.data->buf + msg.data->len, fragment, size); // concatenate fragment
-					msg.data->len += size;
-					if (isLastFragment)
-					{
-						// message complete
-						HandleNextMessage (msg);	
-						m_IncompleteMessages.erase (it); 
-					}	
-					else
-					{	
-						msg.nextFragmentNum++;
-						HandleOutOfSequenceFragment (msgID, msg);
-					}	
-				}
-				else
-				{
-					LogPrint ("Fragment ", m.nextFragmentNum, " of message ", msgID, "exceeds max I2NP message size. Message dropped");
-					i2p::DeleteI2NPMessage (msg.data);
-					m_IncompleteMessages.erase (it);
-				}
-				i2p::DeleteI2NPMessage (m.data);
-			}
-			else
-			{	
-				LogPrint ("Unexpected fragment ", (int)m.nextFragmentNum, " instead ", (int)msg.nextFragmentNum, " of message ", msgID, ". Saved");
-				AddOutOfSequenceFragment (msgID, m.nextFragmentNum, isLastFragment, m.data);
-			}
-		}
-		else
-		{	
-			LogPrint ("First fragment of message ", msgID, " not found. Saved");
-			AddOutOfSequenceFragment (msgID, m.nextFragmentNum, isLastFragment, m.data);
+				memmove (buf + msg.contiguousLen, buf + msg.nextFragmentNum*TUNNEL_FRAGMENT_MAX_SIZE, msg.fragmentSizes[msg.nextFragmentNum]);
+				msg.contiguousLen += msg.fragmentSizes[msg.nextFragmentNum];
+				msg.nextFragmentNum++;
+			}	
+		}	
+		if (firstFragment)
+		{
+			msg.block.deliveryType = firstFragment->deliveryType;
+			msg.block.hash = firstFragment->hash;
+			msg.block.tunnelID = firstFragment->tunnelID;
+		}	
+		if (isLastFragment)
+			msg.lastFragmentNum = fragmentNum;
+		if (msg.lastFragmentNum >= 0 && msg.nextFragmentNum > msg.lastFragmentNum)
+		{
+			// all fragments received, contiguous already
+			msg.block.data->len = msg.block.data->offset + msg.contiguousLen;
+			TunnelMessageBlock block = msg.block;
+			msg.block.data = nullptr; // passed further
+			DeleteIncompleteMessage (it);
+			l.unlock ();
+			HandleNextMessage (block);
 		}	
+		else if (!inSequence)
+			LogPrint ("Out-of-sequence fragment ", fragmentNum, " of message ", msgID, ". Saved");
 	}	
 
-	void TunnelEndpoint::AddOutOfSequenceFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, I2NPMessage * data)
+	std::map<uint32_t, TunnelEndpoint::IncompleteMessage>::iterator TunnelEndpoint::CreateIncompleteMessage (uint32_t msgID)
 	{
-		auto it = m_OutOfSequenceFragments.find (msgID);
-		if (it == m_OutOfSequenceFragments.end ())
-			m_OutOfSequenceFragments.insert (std::pair<uint32_t, Fragment> (msgID, {fragmentNum, isLastFragment, data}));	
-		else
+		if (m_IncompleteMessages.size () >= (size_t)TUNNEL_ENDPOINT_MAX_INCOMPLETE_MESSAGES)
+			EvictOldestIncompleteMessage ();
+		IncompleteMessage msg;
+		msg.block.deliveryType = eDeliveryTypeLocal;
+		msg.block.tunnelID = 0;
+		msg.block.data = nullptr; // allocated for first received fragment
+		msg.receivedFragments = 0;
+		msg.lastFragmentNum = -1;
+		msg.nextFragmentNum = 0;
+		msg.contiguousLen = 0;
+		msg.totalLen = 0;
+		msg.receiveTime = i2p::util::GetSecondsSinceEpoch ();
+		numIncompleteMessages++;
+		return m_IncompleteMessages.insert (std::make_pair (msgID, msg)).first;
+	}	
+
+	bool TunnelEndpoint::ReserveBuffer (uint32_t msgID, IncompleteMessage& msg, size_t size)
+	{
+		auto data = msg.block.data;
+		if (data && data->maxLen - data->offset >= size) return true; // fits
+		if (data && data->maxLen >= I2NP_MAX_MESSAGE_SIZE) return false; // can't be extended
+		// most messages are 1 or 2 fragments, take bigger buffer only if required
+		// complete message might be forwarded over NTCP, framed in the same buffer
+		size_t maxLen = IsNTCPFrameFitting (I2NP_HEADROOM, size, I2NP_MAX_SHORT_MESSAGE_SIZE) ? 
+			I2NP_MAX_SHORT_MESSAGE_SIZE : I2NP_MAX_MESSAGE_SIZE;
+		// if memory is short endpoint above its fair share makes room by itself, 
+		// share is guaranteed, so total never exceeds twice the limit
+		while (reassemblyMemory + maxLen > TUNNEL_ENDPOINT_MAX_REASSEMBLY_MEMORY &&
+			m_ReassemblyMemory + maxLen > GetFairShare ())
+			if (!EvictOldestIncompleteMessage (msgID)) return false;
+		auto newData = maxLen == I2NP_MAX_SHORT_MESSAGE_SIZE ? NewI2NPShortMessage () : NewI2NPMessage ();
+		if (newData->maxLen - newData->offset < size)
+		{
+			i2p::DeleteI2NPMessage (newData);
+			return false;
+		}	
+		newData->len = newData->offset;
+		reassemblyMemory += newData->maxLen;
+		m_ReassemblyMemory += newData->maxLen;
+		if (data)
+		{
+			// copy fragments received so far
+			memcpy (newData->GetBuffer (), data->GetBuffer (), msg.contiguousLen);
+			for (int i = msg.nextFragmentNum + 1; i < TUNNEL_MAX_NUM_FRAGMENTS; i++)
+				if (msg.receivedFragments & (1ULL << i))
+					memcpy (newData->GetBuffer () + i*TUNNEL_FRAGMENT_MAX_SIZE, 
+						data->GetBuffer () + i*TUNNEL_FRAGMENT_MAX_SIZE, msg.fragmentSizes[i]);
+			reassemblyMemory -= data->maxLen;
+			m_ReassemblyMemory -= data->maxLen;
 			i2p::DeleteI2NPMessage (data);
+		}	
+		msg.block.data = newData;
+		return true;
 	}	
 
-	void TunnelEndpoint::HandleOutOfSequenceFragment (uint32_t msgID, TunnelMessageBlockEx& msg)
+	bool TunnelEndpoint::EvictOldestIncompleteMessage (uint32_t exceptMsgID)
 	{
-		auto it = m_OutOfSequenceFragments.find (msgID);
-		if (it != m_OutOfSequenceFragments.end ())
+		auto oldest = m_IncompleteMessages.end ();
+		for (auto it = m_IncompleteMessages.begin (); it != m_IncompleteMessages.end (); it++)
+			if (it->first != exceptMsgID && (oldest == m_IncompleteMessages.end () || 
+				it->second.receiveTime < oldest->second.receiveTime))
+				oldest = it;
+		if (oldest == m_IncompleteMessages.end ()) return false;
+		LogPrint ("Incomplete message ", oldest->first, " evicted");
+		numEvictedMessages++;
+		DeleteIncompleteMessage (oldest);
+		return true;
+	}	
+
+	void TunnelEndpoint::DeleteIncompleteMessage (std::map<uint32_t, IncompleteMessage>::iterator it)
+	{
+		auto data = it->second.block.data;
+		if (data)
 		{
-			if (it->second.fragmentNum == msg.nextFragmentNum)
+			reassemblyMemory -= data->maxLen;
+			m_ReassemblyMemory -= data->maxLen;
+			i2p::DeleteI2NPMessage (data);
+		}
+		numIncompleteMessages--;
+		m_IncompleteMessages.erase (it);
+	}	
+
+	void TunnelEndpoint::CleanupIncompleteMessages (size_t fairShare)
+	{
+		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
+		std::unique_lock<std::mutex> l(m_IncompleteMessagesMutex);
+		for (auto it = m_IncompleteMessages.begin (); it != m_IncompleteMessages.end ();)
+		{
+			if (ts > it->second.receiveTime + TUNNEL_ENDPOINT_INCOMPLETE_MESSAGE_TIMEOUT)
 			{
-				LogPrint ("Out-of-sequence fragment ", (int)it->second.fragmentNum, " of message ", msgID, " found");
-				auto size = it->second.data->GetLength ();
-				memcpy (msg.data->buf + msg.data->len, it->second.data->GetBuffer (), size); // concatenate out-of-sync fragment
-				msg.data->len += size;
-				if (it->second.isLastFragment)
-				{
-					// message complete
-					HandleNextMessage (msg);	
-					m_IncompleteMessages.erase (msgID); 
-				}	
-				else
-					msg.nextFragmentNum++;
-				i2p::DeleteI2NPMessage (it->second.data);
-				m_OutOfSequenceFragments.erase (it);
-			}	
+				LogPrint ("Incomplete message ", it->first, " expired");
+				numExpiredMessages++;
+				DeleteIncompleteMessage (it++);
+			}
+			else
+				it++;
 		}	
+		// give memory back to endpoints below their share
+		while (reassemblyMemory > TUNNEL_ENDPOINT_MAX_REASSEMBLY_MEMORY && m_ReassemblyMemory > fairShare)
+			if (!EvictOldestIncompleteMessage ()) break;
 	}	
 	
 	void TunnelEndpoint::HandleNextMessage (const TunnelMessageBlock& msg)
@@ -249,9 +388,7 @@ namespace tunnel
 						    msg.data->GetHeader()->typeID == eI2NPDatabaseSearchReply )
 						{
 							// catch RI or reply with new list of routers
-							auto ds = NewI2NPMessage ();
-							*ds = *(msg.data);
-							i2p::data::netdb.PostI2NPMsg (ds);
+							i2p::data::netdb.PostI2NPMsg (ShareI2NPMessage (msg.data)); // transports copy it on write
 						}
 						i2p::transport::transports.SendMessage (msg.hash, msg.data);
 					}
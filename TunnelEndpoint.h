@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <map>
+#include <mutex>
 #include <string>
 #include "I2NPProtocol.h"
 #include "TunnelBase.h"
@@ -11,43 +12,67 @@ namespace i2p
 {
 namespace tunnel
 {
+	const size_t TUNNEL_FRAGMENT_MAX_SIZE = TUNNEL_DATA_MAX_PAYLOAD_SIZE - 7; // 1 (flag) + 4 (msgID) + 2 (size)
+	const int TUNNEL_MAX_NUM_FRAGMENTS = 64; // 6 bits of fragment number
+	const int TUNNEL_ENDPOINT_MAX_INCOMPLETE_MESSAGES = 64; // per endpoint
+	const size_t TUNNEL_ENDPOINT_MAX_REASSEMBLY_MEMORY = 16*1024*1024; // for all endpoints, in bytes, equal share is guaranteed
+	const int TUNNEL_ENDPOINT_INCOMPLETE_MESSAGE_TIMEOUT = 10; // in seconds
+	const int TUNNEL_ENDPOINT_CLEANUP_INTERVAL = 5; // in seconds, by tunnels housekeeping
+
+	struct TunnelEndpointStats
+	{
+		size_t numIncompleteMessages; // currently being reassembled
+		size_t reassemblyMemory; // in bytes
+		size_t numExpiredMessages; // not completed in time
+		size_t numEvictedMessages; // dropped because of memory or per endpoint limit
+		size_t numDroppedFragments; // duplicate, malformed or too long
+	};
+
 	class TunnelEndpoint
 	{	
-		struct TunnelMessageBlockEx: public TunnelMessageBlock
+		// fragments in sequence are placed one after another, out-of-sequence fragment n 
+		// is placed at n*TUNNEL_FRAGMENT_MAX_SIZE and moved when fragments before it are received 
+		struct IncompleteMessage
 		{
-			uint8_t nextFragmentNum;
-		};	
-
-		struct Fragment
-		{
-			uint8_t fragmentNum;
-			bool isLastFragment;
-			I2NPMessage * data;
+			TunnelMessageBlock block; // delivery instructions are known after first fragment
+			uint64_t receivedFragments; // bitmap
+			int lastFragmentNum; // -1 if not received yet
+			int nextFragmentNum; // fragments before it are contiguous
+			size_t contiguousLen, totalLen; // of fragments before next one and of all received
+			uint32_t receiveTime; // of first received fragment, in seconds
+			uint16_t fragmentSizes[TUNNEL_MAX_NUM_FRAGMENTS];
 		};	
 		
 		public:
 
-			TunnelEndpoint (bool isInbound): m_IsInbound (isInbound), m_NumReceivedBytes (0) {};
+			TunnelEndpoint (bool isInbound);
 			~TunnelEndpoint ();
 			size_t GetNumReceivedBytes () const { return m_NumReceivedBytes; };
 			
 			void HandleDecryptedTunnelDataMsg (I2NPMessage * msg);
+			void CleanupIncompleteMessages (size_t fairShare); // expire, trim to fair share if memory is short
 
 		private:
 
-			void HandleFollowOnFragment (uint32_t msgID, bool isLastFragment, const TunnelMessageBlockEx& m);
+			void HandleFragment (uint32_t msgID, int fragmentNum, bool isLastFragment, 
+				const TunnelMessageBlock * firstFragment, const uint8_t * fragment, size_t size);
+			std::map<uint32_t, IncompleteMessage>::iterator CreateIncompleteMessage (uint32_t msgID);
+			bool ReserveBuffer (uint32_t msgID, IncompleteMessage& msg, size_t size); // extends buffer if fragment doesn't fit
+			bool EvictOldestIncompleteMessage (uint32_t exceptMsgID = 0); // returns false if nothing to evict
+			void DeleteIncompleteMessage (std::map<uint32_t, IncompleteMessage>::iterator it);
 			void HandleNextMessage (const TunnelMessageBlock& msg);
-
-			void AddOutOfSequenceFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, I2NPMessage * data);
-			void HandleOutOfSequenceFragment (uint32_t msgID, TunnelMessageBlockEx& msg);
 			
 		private:			
 
-			std::map<uint32_t, TunnelMessageBlockEx> m_IncompleteMessages;
-			std::map<uint32_t, Fragment> m_OutOfSequenceFragments;
+			std::mutex m_IncompleteMessagesMutex; // tunnel's worker and housekeeping
+			std::map<uint32_t, IncompleteMessage> m_IncompleteMessages;
+			size_t m_ReassemblyMemory; // of this endpoint
 			bool m_IsInbound;
 			size_t m_NumReceivedBytes;
 	};	
+
+	TunnelEndpointStats GetTunnelEndpointStats ();
+	void CleanupTunnelEndpoints (); // called by tunnels housekeeping
 }		
 }
 
@@ -1,6 +1,11 @@
 #include <string.h>
+#include <list>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
 #include "I2PEndian.h"
 #include <cryptopp/sha.h>
+#include "sha256.h"
 #include "Log.h"
 #include "RouterContext.h"
 #include "Transports.h"
@@ -37,6 +42,7 @@ namespace tunnel
 
 		// create fragments
 		I2NPMessage * msg = block.data;
+		msg->UpdateChks (); // long header goes into fragments
 		auto fullMsgLen = diLen + msg->GetLength () + 2; // delivery instructions + payload + 2 bytes length
 		if (fullMsgLen <= m_RemainingSize)
 		{
@@ -127,11 +133,12 @@ namespace tunnel
 	void TunnelGatewayBuffer::ClearTunnelDataMsgs ()
 	{
 		m_TunnelDataMsgs.clear ();
+		m_TunnelDataMsgsSize = 0;
 	}
 
 	void TunnelGatewayBuffer::CreateCurrentTunnelDataMessage ()
 	{
-		m_CurrentTunnelDataMsg = NewI2NPMessage ();
+		m_CurrentTunnelDataMsg = NewI2NPShortMessage (); // fits padding reserve and 1003 bytes of payload
 		m_CurrentTunnelDataMsg->Align (12);
 		// we reserve space for padding
 		m_CurrentTunnelDataMsg->offset += TUNNEL_DATA_MSG_SIZE + sizeof (I2NPHeader);
@@ -152,7 +159,7 @@ namespace tunnel
 		rnd.GenerateBlock (buf + 4, 16); // original IV	
 		memcpy (payload + size, buf + 4, 16); // copy IV for checksum 
 		uint8_t hash[32];
-		CryptoPP::SHA256().CalculateDigest (hash, payload, size+16);
+		i2p::crypto::SHA256 (payload, size+16, hash);
 		memcpy (buf+20, hash, 4); // checksum		
 		payload[-1] = 0; // zero	
 		ptrdiff_t paddingSize = payload - buf - 25; // 25  = 24 + 1 
@@ -161,28 +168,229 @@ namespace tunnel
 
 		// we can't fill message header yet because encryption is required
 		m_TunnelDataMsgs.push_back (m_CurrentTunnelDataMsg);
+		m_TunnelDataMsgsSize += size;
 		m_CurrentTunnelDataMsg = nullptr;
 	}	
 	
+	class TunnelGatewaysFlusher // sends partially filled tunnel messages after coalescing window
+	{
+		public:
+
+			TunnelGatewaysFlusher (): m_IsRunning (false), m_Thread (nullptr), m_CoalescingWindow (0) {};
+			~TunnelGatewaysFlusher () { Stop (); };
+
+			void Start (int coalescingWindow);
+			void Stop ();
+			int GetCoalescingWindow () const { return m_CoalescingWindow; };
+			void Schedule (TunnelGateway * gateway);
+			void Cancel (TunnelGateway * gateway);
+
+		private:
+
+			void Run ();
+
+		private:
+
+			bool m_IsRunning;
+			std::thread * m_Thread;
+			std::atomic<int> m_CoalescingWindow; // in microseconds
+			std::mutex m_Mutex;
+			std::condition_variable m_Scheduled, m_Flushed;
+			// window is the same for all gateways, deadlines are in ascending order
+			std::list<std::pair<std::chrono::steady_clock::time_point, TunnelGateway *> > m_Gateways;
+	};
+
+	void TunnelGatewaysFlusher::Start (int coalescingWindow)
+	{
+		if (coalescingWindow <= 0 || m_Thread) return;
+		m_CoalescingWindow = coalescingWindow;
+		m_IsRunning = true;
+		m_Thread = new std::thread (std::bind (&TunnelGatewaysFlusher::Run, this));
+	}
+
+	void TunnelGatewaysFlusher::Stop ()
+	{
+		m_CoalescingWindow = 0; // gateways send immediately from now on
+		{
+			std::unique_lock<std::mutex> l(m_Mutex);
+			m_IsRunning = false;
+			m_Scheduled.notify_one ();
+		}
+		if (m_Thread)
+		{	
+			m_Thread->join (); 
+			delete m_Thread;
+			m_Thread = nullptr;
+		}	
+		// flush what is left
+		std::unique_lock<std::mutex> l(m_Mutex);
+		for (auto& it: m_Gateways)
+		{
+			it.second->Flush ();
+			it.second->m_IsFlushScheduled = false;
+		}	
+		m_Gateways.clear ();
+	}
+
+	void TunnelGatewaysFlusher::Schedule (TunnelGateway * gateway)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_IsRunning)
+		{
+			gateway->Flush (); // stopped meanwhile
+			return;
+		}	
+		if (gateway->m_IsFlushScheduled) return; // will be flushed earlier
+		gateway->m_IsFlushScheduled = true;
+		m_Gateways.push_back (std::make_pair (std::chrono::steady_clock::now () + 
+			std::chrono::microseconds (m_CoalescingWindow), gateway));
+		if (m_Gateways.size () == 1)
+			m_Scheduled.notify_one ();
+	}
+
+	void TunnelGatewaysFlusher::Cancel (TunnelGateway * gateway)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		for (auto it = m_Gateways.begin (); it != m_Gateways.end (); it++)
+			if (it->second == gateway)
+			{
+				m_Gateways.erase (it);
+				break;
+			}	
+		gateway->m_IsFlushScheduled = false;
+		m_Flushed.wait (l, [gateway]() { return !gateway->m_IsBeingFlushed; }); // flush in progress
+	}
+
+	void TunnelGatewaysFlusher::Run ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		while (m_IsRunning)
+		{
+			if (m_Gateways.empty ())
+			{
+				m_Scheduled.wait (l);
+				continue;
+			}	
+			auto deadline = m_Gateways.front ().first;
+			if (std::chrono::steady_clock::now () < deadline)
+			{
+				m_Scheduled.wait_until (l, deadline);
+				continue;
+			}
+			auto gateway = m_Gateways.front ().second;
+			m_Gateways.pop_front ();
+			// set before reset, see ~TunnelGateway. Sent during flush is scheduled again 
+			gateway->m_IsBeingFlushed = true;
+			gateway->m_IsFlushScheduled = false; 
+			l.unlock ();
+			try
+			{
+				gateway->Flush (); // gateway can't be deleted meanwhile, Cancel waits
+			}
+			catch (std::exception& ex)
+			{
+				LogPrint ("Tunnel gateways flusher: ", ex.what ());
+			}	
+			l.lock ();
+			gateway->m_IsBeingFlushed = false;
+			m_Flushed.notify_all ();
+		}	
+	}
+
+	static TunnelGatewaysFlusher tunnelGatewaysFlusher;
+	static std::atomic<size_t> numTunnelDataMsgs (0), numUncoalescedMsgs (0);
+	static std::atomic<uint64_t> numPayloadBytes (0);
+
+	void StartTunnelGatewaysFlusher (int coalescingWindow)
+	{
+		tunnelGatewaysFlusher.Start (coalescingWindow);
+	}	
+
+	void StopTunnelGatewaysFlusher ()
+	{
+		tunnelGatewaysFlusher.Stop ();
+	}	
+
+	int GetTunnelGatewaysCoalescingWindow ()
+	{
+		return tunnelGatewaysFlusher.GetCoalescingWindow ();
+	}	
+
+	TunnelGatewayStats GetTunnelGatewayStats ()
+	{
+		return TunnelGatewayStats { numTunnelDataMsgs, numUncoalescedMsgs, numPayloadBytes };
+	}	
+
+	TunnelGateway::~TunnelGateway ()
+	{
+		if (m_IsFlushScheduled || m_IsBeingFlushed) // in this order
+			tunnelGatewaysFlusher.Cancel (this);
+	}	
+
 	void TunnelGateway::SendTunnelDataMsg (const TunnelMessageBlock& block)
 	{
 		if (block.data)
 		{	
-			PutTunnelDataMsg (block);
-			SendBuffer ();
+			bool scheduleFlush;
+			{
+				std::unique_lock<std::mutex> l(m_SendMutex);
+				size_t size = m_Buffer.GetTunnelDataMsgsSize () + m_Buffer.GetCurrentSize ();
+				m_Buffer.PutI2NPMsg (block);
+				scheduleFlush = Send (m_Buffer.GetTunnelDataMsgsSize () + m_Buffer.GetCurrentSize () - size);
+			}
+			if (scheduleFlush) // outside of our mutex, flusher locks it while holding own
+				tunnelGatewaysFlusher.Schedule (this);
 		}	
 	}	
 
-	void TunnelGateway::PutTunnelDataMsg (const TunnelMessageBlock& block)
+	void TunnelGateway::SendTunnelDataMsgs (const std::vector<TunnelMessageBlock>& blocks)
 	{
-		if (block.data)
-			m_Buffer.PutI2NPMsg (block);
+		bool scheduleFlush;
+		{
+			std::unique_lock<std::mutex> l(m_SendMutex);
+			size_t size = m_Buffer.GetTunnelDataMsgsSize () + m_Buffer.GetCurrentSize ();
+			for (auto& it : blocks)
+				if (it.data)
+					m_Buffer.PutI2NPMsg (it);
+			scheduleFlush = Send (m_Buffer.GetTunnelDataMsgsSize () + m_Buffer.GetCurrentSize () - size);
+		}
+		if (scheduleFlush)
+			tunnelGatewaysFlusher.Schedule (this);
+	}	
+
+	void TunnelGateway::Flush ()
+	{
+		std::unique_lock<std::mutex> l(m_SendMutex);
+		SendBuffer ();
+	}	
+
+	bool TunnelGateway::Send (size_t size)
+	{
+		// without coalescing every send would take its own tunnel messages
+		numUncoalescedMsgs += size ? (size + TUNNEL_DATA_MAX_PAYLOAD_SIZE - 1)/TUNNEL_DATA_MAX_PAYLOAD_SIZE : 0;
+		if (!tunnelGatewaysFlusher.GetCoalescingWindow () || 
+			m_Buffer.GetCurrentSize () >= TUNNEL_GATEWAY_COALESCING_SIZE)
+		{
+			SendBuffer ();
+			return false;
+		}	
+		// send full messages now, wait for more to fill current one
+		SendCompleted ();
+		return m_Buffer.GetCurrentSize () > 0;
 	}	
 
 	void TunnelGateway::SendBuffer ()
 	{
 		m_Buffer.CompleteCurrentTunnelDataMessage ();
+		SendCompleted ();
+	}	
+
+	void TunnelGateway::SendCompleted ()
+	{
 		auto tunnelMsgs = m_Buffer.GetTunnelDataMsgs ();
+		if (tunnelMsgs.empty ()) return;
+		numTunnelDataMsgs += tunnelMsgs.size ();
+		numPayloadBytes += m_Buffer.GetTunnelDataMsgsSize ();
 		for (auto tunnelMsg : tunnelMsgs)
 		{	
 			m_Tunnel->EncryptTunnelMsg (tunnelMsg);
@@ -3,6 +3,8 @@
 
 #include <inttypes.h>
 #include <vector>
+#include <mutex>
+#include <atomic>
 #include "I2NPProtocol.h"
 #include "TunnelBase.h"
 
@@ -10,13 +12,24 @@ namespace i2p
 {
 namespace tunnel
 {
+	const size_t TUNNEL_GATEWAY_COALESCING_SIZE = 768; // payload bytes, current tunnel message is sent without waiting
+
+	struct TunnelGatewayStats
+	{
+		size_t numTunnelDataMsgs; // sent
+		size_t numUncoalescedMsgs; // would be sent if every message was sent immediately
+		uint64_t numPayloadBytes;
+	};	
+	
 	class TunnelGatewayBuffer
 	{
 		public:
 			TunnelGatewayBuffer (uint32_t tunnelID): m_TunnelID (tunnelID), 
-				m_CurrentTunnelDataMsg (nullptr), m_RemainingSize (0) {};
+				m_CurrentTunnelDataMsg (nullptr), m_RemainingSize (0), m_TunnelDataMsgsSize (0) {};
 			void PutI2NPMsg (const TunnelMessageBlock& block);	
 			const std::vector<I2NPMessage *>& GetTunnelDataMsgs () const { return m_TunnelDataMsgs; };
+			size_t GetTunnelDataMsgsSize () const { return m_TunnelDataMsgsSize; }; // payload of completed messages
+			size_t GetCurrentSize () const { return m_CurrentTunnelDataMsg ? TUNNEL_DATA_MAX_PAYLOAD_SIZE - m_RemainingSize : 0; };
 			void ClearTunnelDataMsgs ();
 			void CompleteCurrentTunnelDataMessage ();
 
@@ -29,7 +42,7 @@ namespace tunnel
 			uint32_t m_TunnelID;
 			std::vector<I2NPMessage *> m_TunnelDataMsgs;
 			I2NPMessage * m_CurrentTunnelDataMsg;
-			size_t m_RemainingSize;
+			size_t m_RemainingSize, m_TunnelDataMsgsSize;
 	};	
 
 	class TunnelGateway
@@ -37,18 +50,35 @@ namespace tunnel
 		public:
 
 			TunnelGateway (TunnelBase * tunnel): 
-				m_Tunnel (tunnel), m_Buffer (tunnel->GetNextTunnelID ()), m_NumSentBytes (0) {};
+				m_Tunnel (tunnel), m_Buffer (tunnel->GetNextTunnelID ()), m_NumSentBytes (0),
+				m_IsFlushScheduled (false), m_IsBeingFlushed (false) {};
+			~TunnelGateway ();
 			void SendTunnelDataMsg (const TunnelMessageBlock& block);	
-			void PutTunnelDataMsg (const TunnelMessageBlock& block);
-			void SendBuffer ();			
+			void SendTunnelDataMsgs (const std::vector<TunnelMessageBlock>& blocks); // packed together
+			void Flush (); // send partially filled tunnel message
 			size_t GetNumSentBytes () const { return m_NumSentBytes; };
 		
 		private:
 
+			bool Send (size_t size); // returns true if flush is required later 
+			void SendBuffer ();
+			void SendCompleted ();
+
+		private:
+
+			std::mutex m_SendMutex;
 			TunnelBase * m_Tunnel;
 			TunnelGatewayBuffer m_Buffer;
 			size_t m_NumSentBytes;
+			std::atomic<bool> m_IsFlushScheduled, m_IsBeingFlushed; // set and reset by flusher only
+
+		friend class TunnelGatewaysFlusher;	
 	};	
+
+	void StartTunnelGatewaysFlusher (int coalescingWindow); // in microseconds, 0 means no coalescing
+	void StopTunnelGatewaysFlusher ();
+	int GetTunnelGatewaysCoalescingWindow ();
+	TunnelGatewayStats GetTunnelGatewayStats ();
 }		
 }	
 
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include "I2PEndian.h"
 #include "CryptoConst.h"
 #include "Tunnel.h"
 #include "NetDb.h"
+#include "Profiling.h"
 #include "Timestamp.h"
 #include "Garlic.h"
 #include "TunnelPool.h"
@@ -12,7 +14,8 @@ namespace tunnel
 {
 	TunnelPool::TunnelPool (i2p::garlic::GarlicDestination& localDestination, int numInboundHops, int numOutboundHops, int numTunnels):
 		m_LocalDestination (localDestination), m_NumInboundHops (numInboundHops), m_NumOutboundHops (numOutboundHops),
-		m_NumTunnels (numTunnels), m_IsActive (true)
+		m_NumTunnels (numTunnels), m_NumInboundSpareTunnels (DEFAULT_NUM_SPARE_TUNNELS),
+		m_NumOutboundSpareTunnels (DEFAULT_NUM_SPARE_TUNNELS), m_NumTestRounds (0), m_IsActive (true)
 	{
 	}
 
@@ -35,6 +38,7 @@ namespace tunnel
 				it->SetTunnelPool (nullptr);
 			m_OutboundTunnels.clear ();
 		}
+		std::unique_lock<std::mutex> l(m_TestsMutex);
 		m_Tests.clear ();
 	}	
 		
@@ -53,10 +57,12 @@ namespace tunnel
 		if (expiredTunnel)
 		{	
 			expiredTunnel->SetTunnelPool (nullptr);
-			for (auto it: m_Tests)
-				if (it.second.second == expiredTunnel) it.second.second = nullptr;
-			RecreateInboundTunnel (expiredTunnel);	
-
+			{
+				std::unique_lock<std::mutex> l(m_TestsMutex);
+				for (auto& it: m_Tests)
+					if (it.second.second == expiredTunnel) it.second.second = nullptr;
+			}	
+			// replacement has been built by CreateTunnels ahead of expiration
 			std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
 			m_InboundTunnels.erase (expiredTunnel);
 		}	
@@ -74,9 +80,11 @@ namespace tunnel
 		if (expiredTunnel)
 		{
 			expiredTunnel->SetTunnelPool (nullptr);
-			for (auto it: m_Tests)
-				if (it.second.first == expiredTunnel) it.second.first = nullptr;
-			RecreateOutboundTunnel (expiredTunnel);
+			{
+				std::unique_lock<std::mutex> l(m_TestsMutex);
+				for (auto& it: m_Tests)
+					if (it.second.first == expiredTunnel) it.second.first = nullptr;
+			}	
 
 			std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex);
 			m_OutboundTunnels.erase (expiredTunnel);
@@ -86,16 +94,17 @@ namespace tunnel
 	std::vector<InboundTunnel *> TunnelPool::GetInboundTunnels (int num) const
 	{
 		std::vector<InboundTunnel *> v;
-		int i = 0;
-		std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
-		for (auto it : m_InboundTunnels)
 		{
-			if (i >= num) break;
-			if (it->IsEstablished ())
-			{
-				v.push_back (it);
-				i++;
-			}	
+			std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
+			GetEstablishedTunnels (m_InboundTunnels, v);
+		}	
+		if ((int)v.size () > num)
+		{
+			// swap one of selected tunnels with random slower one, leases don't always point to the same tunnels
+			CryptoPP::RandomNumberGenerator& rnd = i2p::context.GetRandomNumberGenerator ();
+			if (num > 0 && rnd.GenerateWord32 (0, 1))
+				std::swap (v[rnd.GenerateWord32 (0, num - 1)], v[rnd.GenerateWord32 (num, v.size () - 1)]);
+			v.resize (num);
 		}	
 		return v;
 	}
@@ -120,48 +129,109 @@ namespace tunnel
 		if (suggested && tunnels.count (suggested) > 0 && suggested->IsEstablished ())
 				return suggested;
 		
+		std::vector<typename TTunnels::value_type> established;
+		GetEstablishedTunnels (tunnels, established);
+		if (established.empty ()) return nullptr;
+		// random one of faster half
 		CryptoPP::RandomNumberGenerator& rnd = i2p::context.GetRandomNumberGenerator ();
-		uint32_t ind = rnd.GenerateWord32 (0, tunnels.size ()/2), i = 0;
-		typename TTunnels::value_type tunnel = nullptr;
+		uint32_t ind = rnd.GenerateWord32 (0, established.size ()/2);
+		if (ind >= established.size ()) ind = established.size () - 1;
+		return established[ind];
+	}
+
+	template<class TTunnels>
+	void TunnelPool::GetEstablishedTunnels (const TTunnels& tunnels, 
+		std::vector<typename TTunnels::value_type>& established) const
+	{
+		int totalLatency = 0, numTested = 0;
 		for (auto it: tunnels)
-		{	
 			if (it->IsEstablished ())
 			{
-				tunnel = it;
-				i++;
-			}
-			if (i > ind && tunnel) break;
-		}	
-		return tunnel;
+				established.push_back (it);
+				if (it->GetMeanLatency ())
+				{
+					totalLatency += it->GetMeanLatency ();
+					numTested++;
+				}	
+			}	
+		// not tested yet tunnels are considered as average, newer first if equal
+		int averageLatency = numTested ? totalLatency/numTested : 0;
+		std::stable_sort (established.begin (), established.end (), 
+			[averageLatency](typename TTunnels::value_type t1, typename TTunnels::value_type t2)
+			{
+				int l1 = t1->GetMeanLatency (), l2 = t2->GetMeanLatency ();
+				return (l1 ? l1 : averageLatency) < (l2 ? l2 : averageLatency);
+			});
 	}
 
-	void TunnelPool::CreateTunnels ()
+	template<class TTunnels>
+	static int CountTunnels (const TTunnels& tunnels, uint32_t ts) // established and not expiring before ts
 	{
+		int num = 0;
+		for (auto it : tunnels)
+			if (it->IsEstablished () && it->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT > ts) num++;
+		return num;
+	}	
+
+	void TunnelPool::CreateTunnels (int numPendingInbound, int numPendingOutbound)
+	{
+		// tunnels expiring before replacement is expected to be built are not counted
+		uint32_t ts = i2p::util::GetSecondsSinceEpoch () + tunnels.GetRebuildLeadTime ();
 		int num = 0;
 		{
 			std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
-			for (auto it : m_InboundTunnels)
-				if (it->IsEstablished ()) num++;
+			num = CountTunnels (m_InboundTunnels, ts);
 		}
-		for (int i = num; i < m_NumTunnels; i++)
+		for (int i = GetNumTunnelsToBuild (num, numPendingInbound, m_NumInboundSpareTunnels); i > 0; i--)
 			CreateInboundTunnel ();	
 		
-		num = 0;
 		{
 			std::unique_lock<std::mutex> l(m_OutboundTunnelsMutex);	
-			for (auto it : m_OutboundTunnels)
-				if (it->IsEstablished ()) num++;
+			num = CountTunnels (m_OutboundTunnels, ts);
 		}
-		for (int i = num; i < m_NumTunnels; i++)
+		for (int i = GetNumTunnelsToBuild (num, numPendingOutbound, m_NumOutboundSpareTunnels); i > 0; i--)
 			CreateOutboundTunnel ();	
 	}
 
+	int TunnelPool::GetNumTunnelsToBuild (int numTunnels, int numPending, int numSpare) const
+	{
+		// pending builds are expected to succeed with observed rate, 
+		// start as many as needed to cover failures at once rather than one after another
+		int successRate = tunnels.GetBuildSuccessRate ();
+		if (successRate < TUNNEL_BUILD_MIN_SUCCESS_RATE) successRate = TUNNEL_BUILD_MIN_SUCCESS_RATE;
+		int numWanted = m_NumTunnels + numSpare;
+		int missing = (numWanted - numTunnels)*1000 - numPending*successRate; // per mille of tunnel
+		if (missing <= 0) return 0;
+		int num = (missing + successRate - 1)/successRate;
+		if (num > numWanted*TUNNEL_POOL_MAX_PENDING_BUILDS_RATIO - numPending)
+			num = numWanted*TUNNEL_POOL_MAX_PENDING_BUILDS_RATIO - numPending;
+		if (num > MAX_NUM_PENDING_TUNNEL_BUILDS - tunnels.GetNumPendingTunnels ())
+			num = MAX_NUM_PENDING_TUNNEL_BUILDS - tunnels.GetNumPendingTunnels ();
+		return num;
+	}
+
+	static void UpdateProfiles (const Tunnel * tunnel, int latency) // negative if test failed
+	{
+		if (!tunnel) return;
+		for (auto hop = tunnel->GetTunnelConfig ()->GetFirstHop (); hop; hop = hop->next)
+		{
+			if (latency >= 0)
+				i2p::data::profiles.TunnelTestSucceeded (hop->router->GetIdentHash (), latency);
+			else
+				i2p::data::profiles.TunnelTestFailed (hop->router->GetIdentHash ());
+		}	
+	}	
+
 	void TunnelPool::TestTunnels ()
 	{
 		auto& rnd = i2p::context.GetRandomNumberGenerator ();
+		std::vector<std::pair<uint32_t, std::pair<OutboundTunnel *, InboundTunnel *> > > newTests;
+		std::unique_lock<std::mutex> l(m_TestsMutex);
 		for (auto it: m_Tests)
 		{
 			LogPrint ("Tunnel test ", (int)it.first, " failed"); 
+			UpdateProfiles (it.second.first, -1);
+			UpdateProfiles (it.second.second, -1);
 			// if test failed again with another tunnel we consider it failed
 			if (it.second.first)
 			{	
@@ -191,57 +261,91 @@ namespace tunnel
 		}
 		m_Tests.clear ();
 		// new tests	
-		auto it1 = m_OutboundTunnels.begin ();
-		auto it2 = m_InboundTunnels.begin ();
-		while (it1 != m_OutboundTunnels.end () && it2 != m_InboundTunnels.end ())
 		{
-			bool failed = false;
-			if ((*it1)->IsFailed ())
-			{	
-				failed = true;
-				it1++;
-			}
-			if ((*it2)->IsFailed ())
-			{	
-				failed = true;
-				it2++;
-			}
-			if (!failed)
+			// round trip can't be split between tunnels of the pair, it's added to both.
+			// Partners change every round, tunnel's average is taken over different partners 
+			std::vector<OutboundTunnel *> outboundTunnels;
+			std::vector<InboundTunnel *> inboundTunnels;
+			std::unique_lock<std::mutex> l1(m_OutboundTunnelsMutex);
+			std::unique_lock<std::mutex> l2(m_InboundTunnelsMutex);
+			for (auto it: m_OutboundTunnels)
+				if (!it->IsFailed ()) outboundTunnels.push_back (it);
+			for (auto it: m_InboundTunnels)
+				if (!it->IsFailed ()) inboundTunnels.push_back (it);
+			size_t num = std::min (outboundTunnels.size (), inboundTunnels.size ());
+			m_NumTestRounds++;
+			for (size_t i = 0; i < num; i++)
 			{
- 				uint32_t msgID = rnd.GenerateWord32 ();
- 				m_Tests[msgID] = std::make_pair (*it1, *it2);
- 				(*it1)->SendTunnelDataMsg ((*it2)->GetNextIdentHash (), (*it2)->GetNextTunnelID (),
-					CreateDeliveryStatusMsg (msgID));
-				it1++; it2++;
-			}	
+				auto outboundTunnel = outboundTunnels[(i + m_NumTestRounds) % outboundTunnels.size ()];
+				auto inboundTunnel = inboundTunnels[(i + 2*m_NumTestRounds) % inboundTunnels.size ()];
+				uint32_t msgID = rnd.GenerateWord32 ();
+				m_Tests[msgID] = std::make_pair (outboundTunnel, inboundTunnel);
+				newTests.push_back (std::make_pair (msgID, std::make_pair (outboundTunnel, inboundTunnel)));
+			}
 		}
+		// tunnels are deleted by housekeeping thread only, which is us	
+		l.unlock ();
+		for (auto it: newTests)
+ 			it.second.first->SendTunnelDataMsg (it.second.second->GetNextIdentHash (), 
+				it.second.second->GetNextTunnelID (), CreateDeliveryStatusMsg (it.first));
 	}
 
 	void TunnelPool::ProcessDeliveryStatus (I2NPMessage * msg)
 	{
 		I2NPDeliveryStatusMsg * deliveryStatus = (I2NPDeliveryStatusMsg *)msg->GetPayload ();
-		auto it = m_Tests.find (be32toh (deliveryStatus->msgID));
-		if (it != m_Tests.end ())
 		{
-			// restore from test failed state if any
-			if (it->second.first->GetState () == eTunnelStateTestFailed)
-				it->second.first->SetState (eTunnelStateEstablished);
-			if (it->second.second->GetState () == eTunnelStateTestFailed)
-				it->second.second->SetState (eTunnelStateEstablished);
-			LogPrint ("Tunnel test ", it->first, " successive. ", i2p::util::GetMillisecondsSinceEpoch () - be64toh (deliveryStatus->timestamp), " milliseconds");
-			m_Tests.erase (it);
-			DeleteI2NPMessage (msg);
-		}
-		else
-			m_LocalDestination.ProcessDeliveryStatusMessage (msg);
+			// tunnels of the test can't expire while we hold the lock
+			std::unique_lock<std::mutex> l(m_TestsMutex);
+			auto it = m_Tests.find (be32toh (deliveryStatus->msgID));
+			if (it != m_Tests.end ())
+			{
+				int latency = i2p::util::GetMillisecondsSinceEpoch () - be64toh (deliveryStatus->timestamp);
+				LogPrint ("Tunnel test ", it->first, " successive. ", latency, " milliseconds");
+				UpdateProfiles (it->second.first, latency);
+				UpdateProfiles (it->second.second, latency);
+				// restore from test failed state if any, round trip goes through both tunnels of the pair
+				if (it->second.first)
+				{	
+					if (it->second.first->GetState () == eTunnelStateTestFailed)
+						it->second.first->SetState (eTunnelStateEstablished);
+					it->second.first->AddLatencySample (latency);
+				}	
+				if (it->second.second)
+				{	
+					if (it->second.second->GetState () == eTunnelStateTestFailed)
+						it->second.second->SetState (eTunnelStateEstablished);
+					it->second.second->AddLatencySample (latency);
+				}	
+				m_Tests.erase (it);
+				DeleteI2NPMessage (msg);
+				return;
+			}
+		}	
+		m_LocalDestination.ProcessDeliveryStatusMessage (msg);
 	}
 
 	std::shared_ptr<const i2p::data::RouterInfo> TunnelPool::SelectNextHop (std::shared_ptr<const i2p::data::RouterInfo> prevHop) const
 	{
+		std::shared_ptr<const i2p::data::RouterInfo> hop;
 		bool isExploratory = (&m_LocalDestination == &i2p::context); // TODO: implement it better
-		auto hop =  isExploratory ? i2p::data::netdb.GetRandomRouter (prevHop): 
-			i2p::data::netdb.GetHighBandwidthRandomRouter (prevHop);
-			
+		if (isExploratory) // explore peers without profiles too
+			hop = i2p::data::netdb.GetRandomRouter (prevHop);
+		else 
+		{
+			// best of few random candidates, still random enough for anonymity
+			int bestScore = 0;
+			for (int i = 0; i < TUNNEL_HOP_SELECTION_NUM_CANDIDATES; i++)
+			{
+				auto candidate = i2p::data::netdb.GetHighBandwidthRandomRouter (prevHop);
+				if (!candidate) break;
+				int score = i2p::data::profiles.GetScore (candidate->GetIdentHash ());
+				if (!hop || score > bestScore)
+				{
+					hop = candidate;
+					bestScore = score;
+				}	
+			}	
+		}	
 		if (!hop)
 			hop = i2p::data::netdb.GetRandomRouter ();
 		return hop;	
@@ -278,16 +382,6 @@ namespace tunnel
 		tunnel->SetTunnelPool (this);
 	}
 
-	void TunnelPool::RecreateInboundTunnel (InboundTunnel * tunnel)
-	{
-		OutboundTunnel * outboundTunnel = GetNextOutboundTunnel ();
-		if (!outboundTunnel)
-			outboundTunnel = tunnels.GetNextOutboundTunnel ();
-		LogPrint ("Re-creating destination inbound tunnel...");
-		auto * newTunnel = tunnels.CreateTunnel<InboundTunnel> (tunnel->GetTunnelConfig ()->Clone (), outboundTunnel);
-		newTunnel->SetTunnelPool (this);
-	}	
-		
 	void TunnelPool::CreateOutboundTunnel ()
 	{
 		InboundTunnel * inboundTunnel = GetNextInboundTunnel ();
@@ -313,21 +407,5 @@ namespace tunnel
 		else
 			LogPrint ("Can't create outbound tunnel. No inbound tunnels found");
 	}	
-		
-	void TunnelPool::RecreateOutboundTunnel (OutboundTunnel * tunnel)
-	{
-		InboundTunnel * inboundTunnel = GetNextInboundTunnel ();
-		if (!inboundTunnel)
-			inboundTunnel = tunnels.GetNextInboundTunnel ();
-		if (inboundTunnel)
-		{	
-			LogPrint ("Re-creating destination outbound tunnel...");
-			auto * newTunnel = tunnels.CreateTunnel<OutboundTunnel> (
-				tunnel->GetTunnelConfig ()->Clone (inboundTunnel->GetTunnelConfig ()));
-			newTunnel->SetTunnelPool (this);
-		}	
-		else
-			LogPrint ("Can't re-create outbound tunnel. No inbound tunnels found");
-	}			
 }
 }
@@ -18,6 +18,10 @@ namespace i2p
 {
 namespace tunnel
 {
+	const int TUNNEL_HOP_SELECTION_NUM_CANDIDATES = 3; // best profile is chosen
+	const int DEFAULT_NUM_SPARE_TUNNELS = 1; // per direction, in addition to numTunnels
+	const int TUNNEL_POOL_MAX_PENDING_BUILDS_RATIO = 2; // of wanted tunnels
+
 	class Tunnel;
 	class InboundTunnel;
 	class OutboundTunnel;
@@ -34,7 +38,7 @@ namespace tunnel
 			i2p::garlic::GarlicDestination& GetLocalDestination () const { return m_LocalDestination; };	
 			bool IsExploratory () const { return GetIdentHash () == i2p::context.GetIdentHash (); };		
 
-			void CreateTunnels ();
+			void CreateTunnels (int numPendingInbound, int numPendingOutbound); // builds in progress
 			void TunnelCreated (InboundTunnel * createdTunnel);
 			void TunnelExpired (InboundTunnel * expiredTunnel);
 			void TunnelCreated (OutboundTunnel * createdTunnel);
@@ -49,28 +53,35 @@ namespace tunnel
 
 			bool IsActive () const { return m_IsActive; };
 			void SetActive (bool isActive) { m_IsActive = isActive; };
+			void SetNumSpareTunnels (int numInbound, int numOutbound) 
+				{ m_NumInboundSpareTunnels = numInbound; m_NumOutboundSpareTunnels = numOutbound; };
 			void DetachTunnels ();
 			
 		private:
 
 			void CreateInboundTunnel ();	
 			void CreateOutboundTunnel ();
-			void RecreateInboundTunnel (InboundTunnel * tunnel);
-			void RecreateOutboundTunnel (OutboundTunnel * tunnel);
+			int GetNumTunnelsToBuild (int numTunnels, int numPending, int numSpare) const;
 			template<class TTunnels>
 			typename TTunnels::value_type GetNextTunnel (TTunnels& tunnels, 
 				typename TTunnels::value_type suggested = nullptr) const;
+			template<class TTunnels>
+			void GetEstablishedTunnels (const TTunnels& tunnels, 
+				std::vector<typename TTunnels::value_type>& established) const; // faster first
 			std::shared_ptr<const i2p::data::RouterInfo> SelectNextHop (std::shared_ptr<const i2p::data::RouterInfo> prevHop) const;
 			
 		private:
 
 			i2p::garlic::GarlicDestination& m_LocalDestination;
 			int m_NumInboundHops, m_NumOutboundHops, m_NumTunnels;
+			int m_NumInboundSpareTunnels, m_NumOutboundSpareTunnels;
 			mutable std::mutex m_InboundTunnelsMutex;
 			std::set<InboundTunnel *, TunnelCreationTimeCmp> m_InboundTunnels; // recent tunnel appears first
 			mutable std::mutex m_OutboundTunnelsMutex;
 			std::set<OutboundTunnel *, TunnelCreationTimeCmp> m_OutboundTunnels;
+			std::mutex m_TestsMutex; // results are processed by tunnel data workers
 			std::map<uint32_t, std::pair<OutboundTunnel *, InboundTunnel *> > m_Tests;
+			uint32_t m_NumTestRounds; // rotates test pairs
 			bool m_IsActive;
 
 		public:
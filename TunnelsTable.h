@@ -0,0 +1,165 @@
+#ifndef TUNNELS_TABLE_H__
+#define TUNNELS_TABLE_H__
+
+#include <inttypes.h>
+#include <atomic>
+#include <list>
+#include <utility>
+
+namespace i2p
+{
+namespace tunnel
+{
+	const size_t TUNNELS_TABLE_MIN_SIZE = 256; // power of 2
+
+	// open addressing by tunnel ID, linear probing, lookups are lock-free
+	// modifications and Reclaim must be serialized by caller
+	// replaced tables are kept until every reader has observed a newer epoch at quiescent state
+	template<class T>
+	class TunnelsTable
+	{
+		struct Slot
+		{
+			std::atomic<uint64_t> key; // 0 if empty, tunnelID + 1 otherwise. Never changes once set
+			std::atomic<T *> tunnel; // nullptr if removed
+		};
+
+		struct Table
+		{
+			Table (size_t s): size (s), numUsed (0)
+			{
+				slots = new Slot[size];
+				for (size_t i = 0; i < size; i++)
+				{
+					slots[i].key.store (0, std::memory_order_relaxed);
+					slots[i].tunnel.store (nullptr, std::memory_order_relaxed);
+				}
+			}
+			~Table () { delete[] slots; };
+
+			size_t size, numUsed; // removed slots are still used until rebuild
+			Slot * slots;
+		};
+
+		public:
+
+			TunnelsTable (std::atomic<uint64_t>& epoch):
+				m_Table (new Table (TUNNELS_TABLE_MIN_SIZE)), m_NumTunnels (0), m_Epoch (epoch) {};
+			~TunnelsTable ()
+			{
+				delete m_Table.load ();
+				for (auto& it: m_Retired)
+					delete it.second;
+			}
+
+			T * Find (uint32_t tunnelID) const
+			{
+				const Table * table = m_Table.load (std::memory_order_acquire);
+				uint64_t key = (uint64_t)tunnelID + 1;
+				size_t mask = table->size - 1;
+				for (size_t i = Hash (tunnelID) & mask;; i = (i + 1) & mask) // at least half of slots are empty
+				{
+					uint64_t k = table->slots[i].key.load (std::memory_order_acquire);
+					if (k == key) return table->slots[i].tunnel.load (std::memory_order_acquire);
+					if (!k) return nullptr;
+				}
+			}
+
+			void Insert (uint32_t tunnelID, T * tunnel)
+			{
+				Table * table = m_Table.load (std::memory_order_relaxed);
+				if ((table->numUsed + 1)*2 > table->size)
+					table = Rebuild ();
+				Slot * slot = GetSlot (table, tunnelID);
+				if (!slot->key.load (std::memory_order_relaxed))
+				{
+					// tunnel must be visible before key
+					slot->tunnel.store (tunnel, std::memory_order_relaxed);
+					slot->key.store ((uint64_t)tunnelID + 1, std::memory_order_release);
+					table->numUsed++;
+					m_NumTunnels++;
+				}
+				else
+				{
+					if (!slot->tunnel.load (std::memory_order_relaxed)) m_NumTunnels++; // was removed
+					slot->tunnel.store (tunnel, std::memory_order_release);
+				}
+			}
+
+			void Remove (uint32_t tunnelID)
+			{
+				Slot * slot = GetSlot (m_Table.load (std::memory_order_relaxed), tunnelID);
+				if (slot->key.load (std::memory_order_relaxed) && slot->tunnel.load (std::memory_order_relaxed))
+				{
+					slot->tunnel.store (nullptr, std::memory_order_release);
+					m_NumTunnels--;
+				}
+			}
+
+			void Reclaim (uint64_t observedEpoch) // minimal epoch observed by all readers
+			{
+				while (!m_Retired.empty () && m_Retired.front ().first <= observedEpoch)
+				{
+					delete m_Retired.front ().second;
+					m_Retired.pop_front ();
+				}
+			}
+
+			size_t GetNumTunnels () const { return m_NumTunnels; };
+			size_t GetNumRetired () const { return m_Retired.size (); };
+
+		private:
+
+			static size_t Hash (uint32_t tunnelID)
+			{
+				uint32_t h = tunnelID ^ (tunnelID >> 16);
+				h *= 0x45d9f3b;
+				return h ^ (h >> 16);
+			}
+
+			Slot * GetSlot (Table * table, uint32_t tunnelID) const // matching or first empty
+			{
+				uint64_t key = (uint64_t)tunnelID + 1;
+				size_t mask = table->size - 1;
+				for (size_t i = Hash (tunnelID) & mask;; i = (i + 1) & mask)
+				{
+					uint64_t k = table->slots[i].key.load (std::memory_order_relaxed);
+					if (k == key || !k) return table->slots + i;
+				}
+			}
+
+			Table * Rebuild () // drop removed tunnels and grow if necessary, keep quarter filled
+			{
+				Table * oldTable = m_Table.load (std::memory_order_relaxed);
+				size_t size = TUNNELS_TABLE_MIN_SIZE;
+				while (size < (m_NumTunnels + 1)*4) size <<= 1;
+				Table * newTable = new Table (size);
+				for (size_t i = 0; i < oldTable->size; i++)
+				{
+					T * tunnel = oldTable->slots[i].tunnel.load (std::memory_order_relaxed);
+					if (tunnel)
+					{
+						uint64_t key = oldTable->slots[i].key.load (std::memory_order_relaxed);
+						Slot * slot = GetSlot (newTable, key - 1);
+						slot->tunnel.store (tunnel, std::memory_order_relaxed);
+						slot->key.store (key, std::memory_order_relaxed);
+						newTable->numUsed++;
+					}
+				}
+				m_Table.store (newTable, std::memory_order_release);
+				// readers might still use old table until they observe new epoch
+				m_Retired.push_back (std::make_pair (++m_Epoch, oldTable));
+				return newTable;
+			}
+
+		private:
+
+			std::atomic<Table *> m_Table;
+			size_t m_NumTunnels;
+			std::atomic<uint64_t>& m_Epoch;
+			std::list<std::pair<uint64_t, Table *> > m_Retired;
+	};
+}
+}
+
+#endif
@@ -154,39 +154,459 @@ namespace crypto
 		);
 	}
 
+	// 4 and 8 blocks interleaved, blocks in xmm0-xmm3 or xmm0-xmm7, round key in xmm8
+	#define AES256Round4(sched, offset, instr) \
+		"movaps "#offset"(%["#sched"]), %%xmm8 \n" \
+		#instr" %%xmm8, %%xmm0 \n" \
+		#instr" %%xmm8, %%xmm1 \n" \
+		#instr" %%xmm8, %%xmm2 \n" \
+		#instr" %%xmm8, %%xmm3 \n"
+
+	#define AES256Round8(sched, offset, instr) \
+		AES256Round4(sched, offset, instr) \
+		#instr" %%xmm8, %%xmm4 \n" \
+		#instr" %%xmm8, %%xmm5 \n" \
+		#instr" %%xmm8, %%xmm6 \n" \
+		#instr" %%xmm8, %%xmm7 \n"
+
+	#define EncryptAES256_4(sched) \
+		AES256Round4(sched, 0, pxor) \
+		AES256Round4(sched, 16, aesenc) \
+		AES256Round4(sched, 32, aesenc) \
+		AES256Round4(sched, 48, aesenc) \
+		AES256Round4(sched, 64, aesenc) \
+		AES256Round4(sched, 80, aesenc) \
+		AES256Round4(sched, 96, aesenc) \
+		AES256Round4(sched, 112, aesenc) \
+		AES256Round4(sched, 128, aesenc) \
+		AES256Round4(sched, 144, aesenc) \
+		AES256Round4(sched, 160, aesenc) \
+		AES256Round4(sched, 176, aesenc) \
+		AES256Round4(sched, 192, aesenc) \
+		AES256Round4(sched, 208, aesenc) \
+		AES256Round4(sched, 224, aesenclast)
+
+	#define EncryptAES256_8(sched) \
+		AES256Round8(sched, 0, pxor) \
+		AES256Round8(sched, 16, aesenc) \
+		AES256Round8(sched, 32, aesenc) \
+		AES256Round8(sched, 48, aesenc) \
+		AES256Round8(sched, 64, aesenc) \
+		AES256Round8(sched, 80, aesenc) \
+		AES256Round8(sched, 96, aesenc) \
+		AES256Round8(sched, 112, aesenc) \
+		AES256Round8(sched, 128, aesenc) \
+		AES256Round8(sched, 144, aesenc) \
+		AES256Round8(sched, 160, aesenc) \
+		AES256Round8(sched, 176, aesenc) \
+		AES256Round8(sched, 192, aesenc) \
+		AES256Round8(sched, 208, aesenc) \
+		AES256Round8(sched, 224, aesenclast)
+
+	#define DecryptAES256_4(sched) \
+		AES256Round4(sched, 224, pxor) \
+		AES256Round4(sched, 208, aesdec) \
+		AES256Round4(sched, 192, aesdec) \
+		AES256Round4(sched, 176, aesdec) \
+		AES256Round4(sched, 160, aesdec) \
+		AES256Round4(sched, 144, aesdec) \
+		AES256Round4(sched, 128, aesdec) \
+		AES256Round4(sched, 112, aesdec) \
+		AES256Round4(sched, 96, aesdec) \
+		AES256Round4(sched, 80, aesdec) \
+		AES256Round4(sched, 64, aesdec) \
+		AES256Round4(sched, 48, aesdec) \
+		AES256Round4(sched, 32, aesdec) \
+		AES256Round4(sched, 16, aesdec) \
+		AES256Round4(sched, 0, aesdeclast)
+
+	#define DecryptAES256_8(sched) \
+		AES256Round8(sched, 224, pxor) \
+		AES256Round8(sched, 208, aesdec) \
+		AES256Round8(sched, 192, aesdec) \
+		AES256Round8(sched, 176, aesdec) \
+		AES256Round8(sched, 160, aesdec) \
+		AES256Round8(sched, 144, aesdec) \
+		AES256Round8(sched, 128, aesdec) \
+		AES256Round8(sched, 112, aesdec) \
+		AES256Round8(sched, 96, aesdec) \
+		AES256Round8(sched, 80, aesdec) \
+		AES256Round8(sched, 64, aesdec) \
+		AES256Round8(sched, 48, aesdec) \
+		AES256Round8(sched, 32, aesdec) \
+		AES256Round8(sched, 16, aesdec) \
+		AES256Round8(sched, 0, aesdeclast)
+
+	#define LoadBlocks4(in) \
+		"movups	(%["#in"]), %%xmm0 \n" \
+		"movups	16(%["#in"]), %%xmm1 \n" \
+		"movups	32(%["#in"]), %%xmm2 \n" \
+		"movups	48(%["#in"]), %%xmm3 \n"
+
+	#define LoadBlocks8(in) \
+		LoadBlocks4(in) \
+		"movups	64(%["#in"]), %%xmm4 \n" \
+		"movups	80(%["#in"]), %%xmm5 \n" \
+		"movups	96(%["#in"]), %%xmm6 \n" \
+		"movups	112(%["#in"]), %%xmm7 \n"
+
+	#define StoreBlocks4(out) \
+		"movups	%%xmm0, (%["#out"]) \n" \
+		"movups	%%xmm1, 16(%["#out"]) \n" \
+		"movups	%%xmm2, 32(%["#out"]) \n" \
+		"movups	%%xmm3, 48(%["#out"]) \n"
+
+	#define StoreBlocks8(out) \
+		StoreBlocks4(out) \
+		"movups	%%xmm4, 64(%["#out"]) \n" \
+		"movups	%%xmm5, 80(%["#out"]) \n" \
+		"movups	%%xmm6, 96(%["#out"]) \n" \
+		"movups	%%xmm7, 112(%["#out"]) \n"
+
+	// xor decrypted block with previous ciphertext block
+	#define CBCXorBlock(in, offset, reg) \
+		"movups	"#offset"(%["#in"]), %%xmm8 \n" \
+		"pxor %%xmm8, %%"#reg" \n"
+
+
+	// VAES, 2 blocks per ymm register, 16 blocks in ymm0-ymm7, round key in both halves of ymm8
+	#define VAES256Round8(sched, offset, instr) \
+		"vbroadcasti128 "#offset"(%["#sched"]), %%ymm8 \n" \
+		#instr" %%ymm8, %%ymm0, %%ymm0 \n" \
+		#instr" %%ymm8, %%ymm1, %%ymm1 \n" \
+		#instr" %%ymm8, %%ymm2, %%ymm2 \n" \
+		#instr" %%ymm8, %%ymm3, %%ymm3 \n" \
+		#instr" %%ymm8, %%ymm4, %%ymm4 \n" \
+		#instr" %%ymm8, %%ymm5, %%ymm5 \n" \
+		#instr" %%ymm8, %%ymm6, %%ymm6 \n" \
+		#instr" %%ymm8, %%ymm7, %%ymm7 \n"
+
+	#define VEncryptAES256_16(sched) \
+		VAES256Round8(sched, 0, vpxor) \
+		VAES256Round8(sched, 16, vaesenc) \
+		VAES256Round8(sched, 32, vaesenc) \
+		VAES256Round8(sched, 48, vaesenc) \
+		VAES256Round8(sched, 64, vaesenc) \
+		VAES256Round8(sched, 80, vaesenc) \
+		VAES256Round8(sched, 96, vaesenc) \
+		VAES256Round8(sched, 112, vaesenc) \
+		VAES256Round8(sched, 128, vaesenc) \
+		VAES256Round8(sched, 144, vaesenc) \
+		VAES256Round8(sched, 160, vaesenc) \
+		VAES256Round8(sched, 176, vaesenc) \
+		VAES256Round8(sched, 192, vaesenc) \
+		VAES256Round8(sched, 208, vaesenc) \
+		VAES256Round8(sched, 224, vaesenclast)
+
+	#define VDecryptAES256_16(sched) \
+		VAES256Round8(sched, 224, vpxor) \
+		VAES256Round8(sched, 208, vaesdec) \
+		VAES256Round8(sched, 192, vaesdec) \
+		VAES256Round8(sched, 176, vaesdec) \
+		VAES256Round8(sched, 160, vaesdec) \
+		VAES256Round8(sched, 144, vaesdec) \
+		VAES256Round8(sched, 128, vaesdec) \
+		VAES256Round8(sched, 112, vaesdec) \
+		VAES256Round8(sched, 96, vaesdec) \
+		VAES256Round8(sched, 80, vaesdec) \
+		VAES256Round8(sched, 64, vaesdec) \
+		VAES256Round8(sched, 48, vaesdec) \
+		VAES256Round8(sched, 32, vaesdec) \
+		VAES256Round8(sched, 16, vaesdec) \
+		VAES256Round8(sched, 0, vaesdeclast)
+
+	#define VLoadBlocks16(in) \
+		"vmovdqu (%["#in"]), %%ymm0 \n" \
+		"vmovdqu 32(%["#in"]), %%ymm1 \n" \
+		"vmovdqu 64(%["#in"]), %%ymm2 \n" \
+		"vmovdqu 96(%["#in"]), %%ymm3 \n" \
+		"vmovdqu 128(%["#in"]), %%ymm4 \n" \
+		"vmovdqu 160(%["#in"]), %%ymm5 \n" \
+		"vmovdqu 192(%["#in"]), %%ymm6 \n" \
+		"vmovdqu 224(%["#in"]), %%ymm7 \n" 
+
+	#define VStoreBlocks16(out) \
+		"vmovdqu %%ymm0, (%["#out"]) \n" \
+		"vmovdqu %%ymm1, 32(%["#out"]) \n" \
+		"vmovdqu %%ymm2, 64(%["#out"]) \n" \
+		"vmovdqu %%ymm3, 96(%["#out"]) \n" \
+		"vmovdqu %%ymm4, 128(%["#out"]) \n" \
+		"vmovdqu %%ymm5, 160(%["#out"]) \n" \
+		"vmovdqu %%ymm6, 192(%["#out"]) \n" \
+		"vmovdqu %%ymm7, 224(%["#out"]) \n" \
+		"vzeroupper \n"
+
+	#define VCBCXorBlocks(in, offset, reg) \
+		"vmovdqu "#offset"(%["#in"]), %%ymm8 \n" \
+		"vpxor %%ymm8, %%"#reg", %%"#reg" \n"
+
+	void ECBEncryptionAESNI::Encrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
+	{
+		if (i2p::cpu::vaes)
+			for (; numBlocks >= 16; numBlocks -= 16, in += 16, out += 16)
+				__asm__
+				(
+					VLoadBlocks16(in)
+					VEncryptAES256_16(sched)
+					VStoreBlocks16(out)
+					: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) 
+					: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "memory"
+				);
+		for (; numBlocks >= 8; numBlocks -= 8, in += 8, out += 8)
+			__asm__
+			(
+				LoadBlocks8(in)
+				EncryptAES256_8(sched)
+				StoreBlocks8(out)
+				: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) 
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "memory"
+			);
+		if (numBlocks >= 4)
+		{
+			__asm__
+			(
+				LoadBlocks4(in)
+				EncryptAES256_4(sched)
+				StoreBlocks4(out)
+				: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) 
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm8", "memory"
+			);
+			numBlocks -= 4; in += 4; out += 4;
+		}
+		for (; numBlocks > 0; numBlocks--)
+			Encrypt (in++, out++);
+	}	
+
+	void ECBDecryptionAESNI::Decrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
+	{
+		if (i2p::cpu::vaes)
+			for (; numBlocks >= 16; numBlocks -= 16, in += 16, out += 16)
+				__asm__
+				(
+					VLoadBlocks16(in)
+					VDecryptAES256_16(sched)
+					VStoreBlocks16(out)
+					: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) 
+					: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "memory"
+				);
+		for (; numBlocks >= 8; numBlocks -= 8, in += 8, out += 8)
+			__asm__
+			(
+				LoadBlocks8(in)
+				DecryptAES256_8(sched)
+				StoreBlocks8(out)
+				: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) 
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "memory"
+			);
+		if (numBlocks >= 4)
+		{
+			__asm__
+			(
+				LoadBlocks4(in)
+				DecryptAES256_4(sched)
+				StoreBlocks4(out)
+				: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) 
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm8", "memory"
+			);
+			numBlocks -= 4; in += 4; out += 4;
+		}
+		for (; numBlocks > 0; numBlocks--)
+			Decrypt (in++, out++);
+	}	
+
+	// CBC decryption is parallel: 16 (VAES), 8 and 4 blocks at once, then block by block 
+	// all blocks are loaded before stored, so in and out can be the same
+	static void CBCDecryptAESNI (const uint8_t * sched, ChipherBlock * iv, int numBlocks, const ChipherBlock * in, ChipherBlock * out)
+	{
+		if (i2p::cpu::vaes)
+			for (; numBlocks >= 16; numBlocks -= 16, in += 16, out += 16)
+				__asm__
+				(
+					VLoadBlocks16(in)
+					VDecryptAES256_16(sched)
+					// first pair is xored with iv and block 0, others with previous blocks
+					"vmovdqu (%[iv]), %%xmm8 \n"
+					"vinserti128 $1, (%[in]), %%ymm8, %%ymm8 \n"
+					"vpxor %%ymm8, %%ymm0, %%ymm0 \n"
+					VCBCXorBlocks(in, 16, ymm1)
+					VCBCXorBlocks(in, 48, ymm2)
+					VCBCXorBlocks(in, 80, ymm3)
+					VCBCXorBlocks(in, 112, ymm4)
+					VCBCXorBlocks(in, 144, ymm5)
+					VCBCXorBlocks(in, 176, ymm6)
+					VCBCXorBlocks(in, 208, ymm7)
+					"vmovdqu 240(%[in]), %%xmm8 \n"
+					"vmovdqu %%xmm8, (%[iv]) \n"
+					VStoreBlocks16(out)
+					: : [sched]"r"(sched), [iv]"r"(iv), [in]"r"(in), [out]"r"(out) 
+					: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "memory"
+				);
+		for (; numBlocks >= 8; numBlocks -= 8, in += 8, out += 8)
+			__asm__
+			(
+				LoadBlocks8(in)
+				DecryptAES256_8(sched)
+				CBCXorBlock(iv, 0, xmm0)
+				CBCXorBlock(in, 0, xmm1)
+				CBCXorBlock(in, 16, xmm2)
+				CBCXorBlock(in, 32, xmm3)
+				CBCXorBlock(in, 48, xmm4)
+				CBCXorBlock(in, 64, xmm5)
+				CBCXorBlock(in, 80, xmm6)
+				CBCXorBlock(in, 96, xmm7)
+				"movups	112(%[in]), %%xmm8 \n"
+				"movups	%%xmm8, (%[iv]) \n"
+				StoreBlocks8(out)
+				: : [sched]"r"(sched), [iv]"r"(iv), [in]"r"(in), [out]"r"(out) 
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "memory"
+			);
+		if (numBlocks >= 4)
+		{
+			__asm__
+			(
+				LoadBlocks4(in)
+				DecryptAES256_4(sched)
+				CBCXorBlock(iv, 0, xmm0)
+				CBCXorBlock(in, 0, xmm1)
+				CBCXorBlock(in, 16, xmm2)
+				CBCXorBlock(in, 32, xmm3)
+				"movups	48(%[in]), %%xmm8 \n"
+				"movups	%%xmm8, (%[iv]) \n"
+				StoreBlocks4(out)
+				: : [sched]"r"(sched), [iv]"r"(iv), [in]"r"(in), [out]"r"(out) 
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm8", "memory"
+			);
+			numBlocks -= 4; in += 4; out += 4;
+		}
+		if (numBlocks > 0)
+			__asm__ __volatile__ // has outputs, must not be optimized out
+			(
+				"movups	(%[iv]), %%xmm1 \n"
+				"1: \n"
+				"movups	(%[in]), %%xmm0 \n"
+				"movaps %%xmm0, %%xmm2 \n"
+				DecryptAES256(sched)
+				"pxor %%xmm1, %%xmm0 \n"
+				"movups	%%xmm0, (%[out]) \n"
+				"movaps %%xmm2, %%xmm1 \n"
+				"add $16, %[in] \n"
+				"add $16, %[out] \n"
+				"dec %[num] \n"
+				"jnz 1b \n"	 	
+				"movups	%%xmm1, (%[iv]) \n"
+				: [in]"+r"(in), [out]"+r"(out), [num]"+r"(numBlocks)
+				: [iv]"r"(iv), [sched]"r"(sched)
+				: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
+			); 
+	}	
+
+
+	// 4 independent lanes, own key schedule per lane, lane block in xmm0-xmm3
+	#define AES256Lanes4(instr, offset) \
+		#instr" "#offset"(%[s0]), %%xmm0 \n" \
+		#instr" "#offset"(%[s1]), %%xmm1 \n" \
+		#instr" "#offset"(%[s2]), %%xmm2 \n" \
+		#instr" "#offset"(%[s3]), %%xmm3 \n"
+
+	#define EncryptAES256Lanes4 \
+		AES256Lanes4(pxor, 0) \
+		AES256Lanes4(aesenc, 16) \
+		AES256Lanes4(aesenc, 32) \
+		AES256Lanes4(aesenc, 48) \
+		AES256Lanes4(aesenc, 64) \
+		AES256Lanes4(aesenc, 80) \
+		AES256Lanes4(aesenc, 96) \
+		AES256Lanes4(aesenc, 112) \
+		AES256Lanes4(aesenc, 128) \
+		AES256Lanes4(aesenc, 144) \
+		AES256Lanes4(aesenc, 160) \
+		AES256Lanes4(aesenc, 176) \
+		AES256Lanes4(aesenc, 192) \
+		AES256Lanes4(aesenc, 208) \
+		AES256Lanes4(aesenclast, 224)
+
+	#define LoadLane(b, reg) \
+		"movups	(%["#b"]), %%"#reg" \n"
+
+	#define LoadLaneCBC(b, reg) \
+		"movups	(%["#b"]), %%"#reg" \n" \
+		"movups	-16(%["#b"]), %%xmm4 \n" \
+		"pxor %%xmm4, %%"#reg" \n"
+
+	#define StoreLanes4 \
+		"movups	%%xmm0, (%[b0]) \n" \
+		"movups	%%xmm1, (%[b1]) \n" \
+		"movups	%%xmm2, (%[b2]) \n" \
+		"movups	%%xmm3, (%[b3]) \n"
+
+	// encrypt one block in place for each lane, CBC chains to the block before  
+	static inline void EncryptAESNILanes4 (uint8_t * const * scheds, uint8_t * const * blocks, bool cbc)
+	{
+		if (cbc)
+			__asm__
+			(
+				LoadLaneCBC(b0, xmm0)
+				LoadLaneCBC(b1, xmm1)
+				LoadLaneCBC(b2, xmm2)
+				LoadLaneCBC(b3, xmm3)
+				EncryptAES256Lanes4
+				StoreLanes4
+				: : [s0]"r"(scheds[0]), [s1]"r"(scheds[1]), [s2]"r"(scheds[2]), [s3]"r"(scheds[3]),
+				  [b0]"r"(blocks[0]), [b1]"r"(blocks[1]), [b2]"r"(blocks[2]), [b3]"r"(blocks[3])
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "memory"
+			);
+		else
+			__asm__
+			(
+				LoadLane(b0, xmm0)
+				LoadLane(b1, xmm1)
+				LoadLane(b2, xmm2)
+				LoadLane(b3, xmm3)
+				EncryptAES256Lanes4
+				StoreLanes4
+				: : [s0]"r"(scheds[0]), [s1]"r"(scheds[1]), [s2]"r"(scheds[2]), [s3]"r"(scheds[3]),
+				  [b0]"r"(blocks[0]), [b1]"r"(blocks[1]), [b2]"r"(blocks[2]), [b3]"r"(blocks[3])
+				: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "memory"
+			);
+	}	
 #endif		
 
 
 	void CBCEncryption::Encrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-		 	"movups	(%[iv]), %%xmm1 \n"
-		 	"1: \n"
-		 	"movups	(%[in]), %%xmm0 \n"
-		 	"pxor %%xmm1, %%xmm0 \n"
-		 	EncryptAES256(sched)
-		 	"movaps	%%xmm0, %%xmm1 \n"	
-		 	"movups	%%xmm0, (%[out]) \n"
-		 	"add $16, %[in] \n"
-		 	"add $16, %[out] \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-		 	"movups	%%xmm1, (%[iv]) \n"
-			: 
-			: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out), [num]"r"(numBlocks)
-			: "%xmm0", "%xmm1", "cc", "memory"
-		); 
-#else		
-		for (int i = 0; i < numBlocks; i++)
+		if (i2p::cpu::aesni)
 		{
-			m_LastBlock ^= in[i];
-			m_ECBEncryption.Encrypt (&m_LastBlock, &m_LastBlock);
-			out[i] = m_LastBlock;
+			__asm__
+			(
+			 	"movups	(%[iv]), %%xmm1 \n"
+			 	"1: \n"
+			 	"movups	(%[in]), %%xmm0 \n"
+			 	"pxor %%xmm1, %%xmm0 \n"
+			 	EncryptAES256(sched)
+			 	"movaps	%%xmm0, %%xmm1 \n"	
+			 	"movups	%%xmm0, (%[out]) \n"
+			 	"add $16, %[in] \n"
+			 	"add $16, %[out] \n"
+			 	"dec %[num] \n"
+			 	"jnz 1b \n"	 	
+			 	"movups	%%xmm1, (%[iv]) \n"
+				: 
+				: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ()), 
+				  [in]"r"(in), [out]"r"(out), [num]"r"(numBlocks)
+				: "%xmm0", "%xmm1", "cc", "memory"
+			); 
+		}
+		else
+#endif
+		{
+			for (int i = 0; i < numBlocks; i++)
+			{
+				m_LastBlock ^= in[i];
+				m_ECBEncryption.Encrypt (&m_LastBlock, &m_LastBlock);
+				out[i] = m_LastBlock;
+			}
 		}
-#endif		
 	}
 
 	void CBCEncryption::Encrypt (const uint8_t * in, std::size_t len, uint8_t * out)
@@ -198,56 +618,47 @@ namespace crypto
 	void CBCEncryption::Encrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-			"movups	(%[iv]), %%xmm1 \n"
-			"movups	(%[in]), %%xmm0 \n"
-		 	"pxor %%xmm1, %%xmm0 \n"
-		 	EncryptAES256(sched)
-			"movups	%%xmm0, (%[out]) \n"
-			"movups	%%xmm0, (%[iv]) \n"
-			: 
-			: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out)
-			: "%xmm0", "%xmm1", "memory"
-		);		
-#else
-		Encrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
+		if (i2p::cpu::aesni)
+		{
+			__asm__
+			(
+				"movups	(%[iv]), %%xmm1 \n"
+				"movups	(%[in]), %%xmm0 \n"
+			 	"pxor %%xmm1, %%xmm0 \n"
+			 	EncryptAES256(sched)
+				"movups	%%xmm0, (%[out]) \n"
+				"movups	%%xmm0, (%[iv]) \n"
+				: 
+				: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ()), 
+				  [in]"r"(in), [out]"r"(out)
+				: "%xmm0", "%xmm1", "memory"
+			);		
+		}
+		else
 #endif
+		{
+			Encrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
+		}
 	}
 
 	void CBCDecryption::Decrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-			"movups	(%[iv]), %%xmm1 \n"
-		 	"1: \n"
-		 	"movups	(%[in]), %%xmm0 \n"
-			"movaps %%xmm0, %%xmm2 \n"
-		 	DecryptAES256(sched)
-			"pxor %%xmm1, %%xmm0 \n"
-		 	"movups	%%xmm0, (%[out]) \n"
-			"movaps %%xmm2, %%xmm1 \n"
-		 	"add $16, %[in] \n"
-		 	"add $16, %[out] \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-		 	"movups	%%xmm1, (%[iv]) \n"
-			: 
-			: [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out), [num]"r"(numBlocks)
-			: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
-		); 
-#else
-		for (int i = 0; i < numBlocks; i++)
+		if (i2p::cpu::aesni)
 		{
-			ChipherBlock tmp = in[i];
-			m_ECBDecryption.Decrypt (in + i, out + i);
-			out[i] ^= m_IV;
-			m_IV = tmp;
+			CBCDecryptAESNI (m_ECBDecryption.GetKeySchedule (), &m_IV, numBlocks, in, out);
 		}
+		else
 #endif
+		{
+			for (int i = 0; i < numBlocks; i++)
+			{
+				ChipherBlock tmp = in[i];
+				m_ECBDecryption.Decrypt (in + i, out + i);
+				out[i] ^= m_IV;
+				m_IV = tmp;
+			}
+		}
 	}
 
 	void CBCDecryption::Decrypt (const uint8_t * in, std::size_t len, uint8_t * out)
@@ -258,93 +669,131 @@ namespace crypto
 	void CBCDecryption::Decrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-			"movups	(%[iv]), %%xmm1 \n"
-		 	"movups	(%[in]), %%xmm0 \n"
-			"movups	%%xmm0, (%[iv]) \n"
-		 	DecryptAES256(sched)
-			"pxor %%xmm1, %%xmm0 \n"
-		 	"movups	%%xmm0, (%[out]) \n"	
-			: 
-			: [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out)
-			: "%xmm0", "%xmm1", "memory"
-		);
-#else
-		Decrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
+		if (i2p::cpu::aesni)
+		{
+			__asm__
+			(
+				"movups	(%[iv]), %%xmm1 \n"
+			 	"movups	(%[in]), %%xmm0 \n"
+				"movups	%%xmm0, (%[iv]) \n"
+			 	DecryptAES256(sched)
+				"pxor %%xmm1, %%xmm0 \n"
+			 	"movups	%%xmm0, (%[out]) \n"	
+				: 
+				: [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ()), 
+				  [in]"r"(in), [out]"r"(out)
+				: "%xmm0", "%xmm1", "memory"
+			);
+		}
+		else
 #endif
+		{
+			Decrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
+		}
 	}
 
 	void TunnelEncryption::Encrypt (uint8_t * payload)
 	{
 #ifdef AESNI
-		__asm__
-		(
-            // encrypt IV 
-			"movups	(%[payload]), %%xmm0 \n"
-			EncryptAES256(sched_iv)
-			"movaps %%xmm0, %%xmm1 \n"
-			// double IV encryption
-			EncryptAES256(sched_iv)
-			"movups %%xmm0, (%[payload]) \n"
-			// encrypt data, IV is xmm1
-			"1: \n"
-			"add $16, %[payload] \n"
-		 	"movups	(%[payload]), %%xmm0 \n"
-		 	"pxor %%xmm1, %%xmm0 \n"
-		 	EncryptAES256(sched_l)
-		 	"movaps	%%xmm0, %%xmm1 \n"	
-		 	"movups	%%xmm0, (%[payload]) \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-			: 
-			: [sched_iv]"r"(m_IVEncryption.GetKeySchedule ()), [sched_l]"r"(m_LayerEncryption.GetKeySchedule ()), 
-			  [payload]"r"(payload), [num]"r"(63) // 63 blocks = 1008 bytes
-			: "%xmm0", "%xmm1", "cc", "memory"
-		);
-#else
-		m_IVEncryption.Encrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // iv
-		m_LayerEncryption.SetIV (payload);
-		m_LayerEncryption.Encrypt (payload + 16, i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE, payload + 16); // data
-		m_IVEncryption.Encrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // double iv
+		if (i2p::cpu::aesni)
+		{
+			__asm__
+			(
+	            // encrypt IV 
+				"movups	(%[payload]), %%xmm0 \n"
+				EncryptAES256(sched_iv)
+				"movaps %%xmm0, %%xmm1 \n"
+				// double IV encryption
+				EncryptAES256(sched_iv)
+				"movups %%xmm0, (%[payload]) \n"
+				// encrypt data, IV is xmm1
+				"1: \n"
+				"add $16, %[payload] \n"
+			 	"movups	(%[payload]), %%xmm0 \n"
+			 	"pxor %%xmm1, %%xmm0 \n"
+			 	EncryptAES256(sched_l)
+			 	"movaps	%%xmm0, %%xmm1 \n"	
+			 	"movups	%%xmm0, (%[payload]) \n"
+			 	"dec %[num] \n"
+			 	"jnz 1b \n"	 	
+				: 
+				: [sched_iv]"r"(m_IVEncryption.GetKeySchedule ()), [sched_l]"r"(m_LayerEncryption.GetKeySchedule ()), 
+				  [payload]"r"(payload), [num]"r"(63) // 63 blocks = 1008 bytes
+				: "%xmm0", "%xmm1", "cc", "memory"
+			);
+		}
+		else
 #endif
+		{
+			m_IVEncryption.Encrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // iv
+			m_LayerEncryption.SetIV (payload);
+			m_LayerEncryption.Encrypt (payload + 16, i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE, payload + 16); // data
+			m_IVEncryption.Encrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // double iv
+		}
 	}
 
+	void TunnelEncryption::Encrypt (int num, TunnelEncryption * const * encryptions, uint8_t * const * payloads)
+	{
+		int i = 0;
+#ifdef AESNI
+		if (i2p::cpu::aesni)
+		{
+			// CBC is serial within a message, so encrypt 4 messages in lockstep 
+			for (; i + 4 <= num; i += 4)
+			{
+				uint8_t * ivScheds[4], * layerScheds[4], * blocks[4];
+				for (int j = 0; j < 4; j++)
+				{
+					ivScheds[j] = encryptions[i + j]->m_IVEncryption.GetKeySchedule ();
+					layerScheds[j] = encryptions[i + j]->m_LayerEncryption.GetKeySchedule ();
+					blocks[j] = payloads[i + j];
+				}
+				EncryptAESNILanes4 (ivScheds, blocks, false); // iv
+				for (int k = 0; k < 63; k++) // 63 blocks = 1008 bytes
+				{
+					for (int j = 0; j < 4; j++) blocks[j] += 16;
+					EncryptAESNILanes4 (layerScheds, blocks, true); // data, chained to encrypted iv first
+				}
+				for (int j = 0; j < 4; j++) blocks[j] = payloads[i + j];
+				EncryptAESNILanes4 (ivScheds, blocks, false); // double iv
+			}
+		}
+#endif
+		for (; i < num; i++)
+			encryptions[i]->Encrypt (payloads[i]);
+	}	
+
 	void TunnelDecryption::Decrypt (uint8_t * payload)
 	{
 #ifdef AESNI
-		__asm__
-		(
-            // decrypt IV 
-			"movups	(%[payload]), %%xmm0 \n"
-			DecryptAES256(sched_iv)
-			"movaps %%xmm0, %%xmm1 \n"
-			// double IV encryption
-			DecryptAES256(sched_iv)
-			"movups %%xmm0, (%[payload]) \n"
-			// decrypt data, IV is xmm1
-			"1: \n"
-			"add $16, %[payload] \n"
-			"movups	(%[payload]), %%xmm0 \n"
-			"movaps %%xmm0, %%xmm2 \n"
-		 	DecryptAES256(sched_l)
-			"pxor %%xmm1, %%xmm0 \n"
-		 	"movups	%%xmm0, (%[payload]) \n"
-			"movaps %%xmm2, %%xmm1 \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-			: 
-			: [sched_iv]"r"(m_IVDecryption.GetKeySchedule ()), [sched_l]"r"(m_LayerDecryption.GetKeySchedule ()), 
-			  [payload]"r"(payload), [num]"r"(63) // 63 blocks = 1008 bytes
-			: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
-		);
-#else
-		m_IVDecryption.Decrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // iv
-		m_LayerDecryption.SetIV (payload);	
-		m_LayerDecryption.Decrypt (payload + 16, i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE, payload + 16); // data
-		m_IVDecryption.Decrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // double iv
+		if (i2p::cpu::aesni)
+		{
+			ChipherBlock iv;
+			__asm__
+			(
+	            // decrypt IV 
+				"movups	(%[payload]), %%xmm0 \n"
+				DecryptAES256(sched_iv)
+				"movups %%xmm0, (%[iv]) \n"
+				// double IV encryption
+				DecryptAES256(sched_iv)
+				"movups %%xmm0, (%[payload]) \n"
+				: 
+				: [sched_iv]"r"(m_IVDecryption.GetKeySchedule ()), [payload]"r"(payload), [iv]"r"(&iv) 
+				: "%xmm0", "memory"
+			);
+			// decrypt data 
+			auto data = (ChipherBlock *)(payload + 16);
+			CBCDecryptAESNI (m_LayerDecryption.GetKeySchedule (), &iv, 63, data, data); // 63 blocks = 1008 bytes
+		}
+		else
 #endif
+		{
+			m_IVDecryption.Decrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // iv
+			m_LayerDecryption.SetIV (payload);	
+			m_LayerDecryption.Decrypt (payload + 16, i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE, payload + 16); // data
+			m_IVDecryption.Decrypt ((ChipherBlock *)payload, (ChipherBlock *)payload); // double iv
+		}
 	}
 }
 }
@@ -5,6 +5,7 @@
 #include <cryptopp/modes.h>
 #include <cryptopp/aes.h>
 #include "Identity.h"
+#include "CPU.h"
 
 namespace i2p
 {
@@ -82,6 +83,7 @@ namespace crypto
 		
 			void SetKey (const AESKey& key) { ExpandKey (key); };
 			void Encrypt (const ChipherBlock * in, ChipherBlock * out);	
+			void Encrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out); // 8 blocks interleaved	
 	};	
 
 	class ECBDecryptionAESNI: public ECBCryptoAESNI
@@ -90,14 +92,11 @@ namespace crypto
 		
 			void SetKey (const AESKey& key);
 			void Decrypt (const ChipherBlock * in, ChipherBlock * out);		
+			void Decrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out); // 8 blocks interleaved		
 	};	
+#endif			
 
-	typedef ECBEncryptionAESNI ECBEncryption;
-	typedef ECBDecryptionAESNI ECBDecryption;
-
-#else // use crypto++
-
-	class ECBEncryption
+	class ECBEncryptionCryptoPP
 	{
 		public:
 		
@@ -109,13 +108,17 @@ namespace crypto
 			{
 				m_Encryption.ProcessData (out->buf, in->buf, 16);
 			}	
+			void Encrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
+			{
+				m_Encryption.ProcessData (out->buf, in->buf, numBlocks*16);
+			}	
 
 		private:
 
 			CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption m_Encryption;
 	};	
 
-	class ECBDecryption
+	class ECBDecryptionCryptoPP
 	{
 		public:
 		
@@ -127,13 +130,68 @@ namespace crypto
 			{
 				m_Decryption.ProcessData (out->buf, in->buf, 16);
 			}	
+			void Decrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
+			{
+				m_Decryption.ProcessData (out->buf, in->buf, numBlocks*16);
+			}	
 
 		private:
 
 			CryptoPP::ECB_Mode<CryptoPP::AES>::Decryption m_Decryption;
 	};		
 
+#ifdef AESNI
+	// implementation is selected at runtime, AES-NI if CPU supports it
+	class ECBEncryption
+	{
+		public:
+		
+			void SetKey (const AESKey& key) 
+			{ 
+				if (i2p::cpu::aesni) m_AESNI.SetKey (key); else m_CryptoPP.SetKey (key); 
+			}
+			void Encrypt (const ChipherBlock * in, ChipherBlock * out)
+			{
+				if (i2p::cpu::aesni) m_AESNI.Encrypt (in, out); else m_CryptoPP.Encrypt (in, out); 
+			}	
+			void Encrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
+			{
+				if (i2p::cpu::aesni) m_AESNI.Encrypt (numBlocks, in, out); else m_CryptoPP.Encrypt (numBlocks, in, out); 
+			}	
+			uint8_t * GetKeySchedule () { return m_AESNI.GetKeySchedule (); }; // AES-NI only
+
+		private:
 
+			ECBEncryptionAESNI m_AESNI;
+			ECBEncryptionCryptoPP m_CryptoPP;
+	};
+
+	class ECBDecryption
+	{
+		public:
+		
+			void SetKey (const AESKey& key) 
+			{ 
+				if (i2p::cpu::aesni) m_AESNI.SetKey (key); else m_CryptoPP.SetKey (key); 
+			}
+			void Decrypt (const ChipherBlock * in, ChipherBlock * out)
+			{
+				if (i2p::cpu::aesni) m_AESNI.Decrypt (in, out); else m_CryptoPP.Decrypt (in, out); 
+			}	
+			void Decrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
+			{
+				if (i2p::cpu::aesni) m_AESNI.Decrypt (numBlocks, in, out); else m_CryptoPP.Decrypt (numBlocks, in, out); 
+			}	
+			uint8_t * GetKeySchedule () { return m_AESNI.GetKeySchedule (); }; // AES-NI only
+
+		private:
+
+			ECBDecryptionAESNI m_AESNI;
+			ECBDecryptionCryptoPP m_CryptoPP;
+	};
+#else
+	typedef ECBEncryptionCryptoPP ECBEncryption;
+	typedef ECBDecryptionCryptoPP ECBDecryption;
 #endif			
 
 	class CBCEncryption
@@ -148,6 +206,9 @@ namespace crypto
 			void Encrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out);
 			void Encrypt (const uint8_t * in, std::size_t len, uint8_t * out);
 			void Encrypt (const uint8_t * in, uint8_t * out); // one block
+#ifdef AESNI
+			uint8_t * GetKeySchedule () { return m_ECBEncryption.GetKeySchedule (); };
+#endif
 
 		private:
 
@@ -168,6 +229,9 @@ namespace crypto
 			void Decrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out);
 			void Decrypt (const uint8_t * in, std::size_t len, uint8_t * out);
 			void Decrypt (const uint8_t * in, uint8_t * out); // one block
+#ifdef AESNI
+			uint8_t * GetKeySchedule () { return m_ECBDecryption.GetKeySchedule (); };
+#endif
 
 		private:
 
@@ -186,15 +250,12 @@ namespace crypto
 			}	
 
 			void Encrypt (uint8_t * payload); // 1024 bytes (16 IV + 1008 data)		
+			static void Encrypt (int num, TunnelEncryption * const * encryptions, uint8_t * const * payloads); // many messages at once 
 
 		private:
 
 			ECBEncryption m_IVEncryption;
-#ifdef AESNI
-			ECBEncryption m_LayerEncryption;
-#else
 			CBCEncryption m_LayerEncryption;
-#endif
 	};
 
 	class TunnelDecryption // with double IV encryption
@@ -212,11 +273,7 @@ namespace crypto
 		private:
 
 			ECBDecryption m_IVDecryption;
-#ifdef AESNI
-			ECBDecryption m_LayerDecryption;
-#else
 			CBCDecryption m_LayerDecryption;
-#endif
 	};
 }
 }
@@ -6,6 +6,7 @@
 #include "Tunnel.h"
 #include "RouterContext.h"
 #include "Identity.h"
+#include "CPU.h"
 #include "Destination.h"
 #include "util.h"
 #include "api.h"
@@ -18,6 +19,7 @@ namespace api
 	{
 		i2p::util::filesystem::SetAppName (appName);
 		i2p::util::config::OptionParser(argc, argv);
+		i2p::cpu::Detect ();
 		i2p::context.Init ();	
 	}
 
@@ -3,11 +3,12 @@ CPP_FILES := ../CryptoConst.cpp ../base64.cpp ../NTCPSession.cpp ../RouterInfo.c
 ../TunnelEndpoint.cpp ../TunnelGateway.cpp ../TransitTunnel.cpp ../I2NPProtocol.cpp \
 ../Log.cpp ../Garlic.cpp ../Streaming.cpp ../Destination.cpp ../Identity.cpp \
 ../SSU.cpp ../SSUSession.cpp ../SSUData.cpp ../util.cpp ../Reseed.cpp ../SSUData.cpp \
-../aes.cpp ../TunnelPool.cpp ../AddressBook.cpp ../Datagram.cpp ../api.cpp
+../aes.cpp ../TunnelPool.cpp ../AddressBook.cpp ../Datagram.cpp ../CPU.cpp \
+../sha256.cpp ../ElGamal.cpp ../Profiling.cpp ../api.cpp
 H_FILES := ../CryptoConst.h ../base64.h ../NTCPSession.h ../RouterInfo.h ../Transports.h \
 ../RouterContext.h ../NetDb.h ../LeaseSet.h ../Tunnel.h ../TunnelEndpoint.h \
 ../TunnelGateway.h ../TransitTunnel.h ../I2NPProtocol.h ../Log.h ../Garlic.h \
 ../Streaming.h ../Destination.h ../Identity.h ../SSU.h ../SSUSession.h ../SSUData.h \
 ../util.h ../Reseed.h ../SSUData.h ../aes.h ../TunnelPool.h ../AddressBook.h ../version.h \
-../Signature.h ../TransportSession.h ../Datagram.h ../api.h
+../Signature.h ../TransportSession.h ../Datagram.h ../CPU.h ../sha256.h ../Profiling.h ../api.h
 OBJECTS = $(addprefix obj/, $(notdir $(CPP_FILES:.cpp=.o)))
@@ -6,7 +6,7 @@ CPP_FILES := CryptoConst.cpp base64.cpp NTCPSession.cpp RouterInfo.cpp Transport
 	Destination.cpp Identity.cpp SSU.cpp SSUSession.cpp SSUData.cpp util.cpp Reseed.cpp \
 	DaemonLinux.cpp SSUData.cpp aes.cpp SOCKS.cpp UPnP.cpp TunnelPool.cpp HTTPProxy.cpp \
 	AddressBook.cpp Daemon.cpp I2PTunnel.cpp SAM.cpp BOB.cpp ClientContext.cpp \
-	Datagram.cpp i2p.cpp
+	Datagram.cpp CPU.cpp sha256.cpp ElGamal.cpp Profiling.cpp i2p.cpp
 
 
 H_FILES := CryptoConst.h base64.h NTCPSession.h RouterInfo.h Transports.h \
@@ -14,8 +14,25 @@ H_FILES := CryptoConst.h base64.h NTCPSession.h RouterInfo.h Transports.h \
 	TransitTunnel.h I2NPProtocol.h Log.h Garlic.h HTTPServer.h Streaming.h Destination.h \
 	Identity.h SSU.h SSUSession.h SSUData.h util.h Reseed.h DaemonLinux.h SSUData.h \
 	aes.h SOCKS.h UPnP.h TunnelPool.h HTTPProxy.h AddressBook.h Daemon.h I2PTunnel.h \
-	version.h Signature.h SAM.h BOB.h ClientContext.h TransportSession.h Datagram.h
+	version.h Signature.h SAM.h BOB.h ClientContext.h TransportSession.h Datagram.h \
+	CPU.h sha256.h TunnelsTable.h TimingWheel.h Profiling.h
 
 
 OBJECTS = $(addprefix obj/, $(notdir $(CPP_FILES:.cpp=.o)))
 
+
+BENCH_CPP_FILES := BenchCrypto.cpp aes.cpp CPU.cpp sha256.cpp CryptoConst.cpp \
+	ElGamal.cpp Log.cpp
+
+
+BENCH_OBJECTS = $(addprefix obj/, $(notdir $(BENCH_CPP_FILES:.cpp=.o)))
+
+
+BENCH_QUEUE_OBJECTS = obj/BenchQueue.o
+
+
+TEST_CPP_FILES := TestCrypto.cpp aes.cpp CPU.cpp sha256.cpp
+
+
+TEST_OBJECTS = $(addprefix obj/, $(notdir $(TEST_CPP_FILES:.cpp=.o)))
+
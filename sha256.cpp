@@ -0,0 +1,112 @@
+#include <string.h>
+#include <cryptopp/sha.h>
+#if defined(AESNI)
+#include <immintrin.h>
+#endif
+#include "I2PEndian.h"
+#include "CPU.h"
+#include "sha256.h"
+
+namespace i2p
+{
+namespace crypto
+{
+#if defined(AESNI)
+	static const uint32_t K[64] = 
+	{
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	// 4 rounds with message words w, K[4*i..4*i+3] 
+	#define SHA256Rounds4(i, w) \
+		m = _mm_add_epi32 (w, _mm_loadu_si128 ((const __m128i *)(K + 4*i))); \
+		state1 = _mm_sha256rnds2_epu32 (state1, state0, m); \
+		state0 = _mm_sha256rnds2_epu32 (state0, state1, _mm_shuffle_epi32 (m, 0x0E))
+
+	// next message words from w0 for 4 rounds later 
+	#define SHA256Schedule(w0, w1, w2, w3) \
+		w0 = _mm_sha256msg2_epu32 (_mm_add_epi32 (_mm_sha256msg1_epu32 (w0, w1), _mm_alignr_epi8 (w3, w2, 4)), w3)
+
+	__attribute__ ((target ("sha,sse4.1")))
+	static void SHA256TransformSHANI (uint32_t * state, const uint8_t * blocks, size_t numBlocks)
+	{
+		const __m128i mask = _mm_set_epi64x (0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL); // big endian words
+		// state in ABEF and CDGH order
+		__m128i tmp = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)state), 0xB1);
+		__m128i state1 = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)(state + 4)), 0x1B);
+		__m128i state0 = _mm_alignr_epi8 (tmp, state1, 8); 
+		state1 = _mm_blend_epi16 (state1, tmp, 0xF0); 
+		for (; numBlocks > 0; numBlocks--, blocks += 64)
+		{
+			__m128i abef = state0, cdgh = state1, m;
+			__m128i w0 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)blocks), mask);
+			__m128i w1 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(blocks + 16)), mask);
+			__m128i w2 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(blocks + 32)), mask);
+			__m128i w3 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(blocks + 48)), mask);
+			SHA256Rounds4 (0, w0); SHA256Schedule (w0, w1, w2, w3);
+			SHA256Rounds4 (1, w1); SHA256Schedule (w1, w2, w3, w0);
+			SHA256Rounds4 (2, w2); SHA256Schedule (w2, w3, w0, w1);
+			SHA256Rounds4 (3, w3); SHA256Schedule (w3, w0, w1, w2);
+			SHA256Rounds4 (4, w0); SHA256Schedule (w0, w1, w2, w3);
+			SHA256Rounds4 (5, w1); SHA256Schedule (w1, w2, w3, w0);
+			SHA256Rounds4 (6, w2); SHA256Schedule (w2, w3, w0, w1);
+			SHA256Rounds4 (7, w3); SHA256Schedule (w3, w0, w1, w2);
+			SHA256Rounds4 (8, w0); SHA256Schedule (w0, w1, w2, w3);
+			SHA256Rounds4 (9, w1); SHA256Schedule (w1, w2, w3, w0);
+			SHA256Rounds4 (10, w2); SHA256Schedule (w2, w3, w0, w1);
+			SHA256Rounds4 (11, w3); SHA256Schedule (w3, w0, w1, w2);
+			SHA256Rounds4 (12, w0);
+			SHA256Rounds4 (13, w1);
+			SHA256Rounds4 (14, w2);
+			SHA256Rounds4 (15, w3);
+			state0 = _mm_add_epi32 (state0, abef);
+			state1 = _mm_add_epi32 (state1, cdgh);
+		}
+		tmp = _mm_shuffle_epi32 (state0, 0x1B); 
+		state1 = _mm_shuffle_epi32 (state1, 0xB1); 
+		_mm_storeu_si128 ((__m128i *)state, _mm_blend_epi16 (tmp, state1, 0xF0)); 
+		_mm_storeu_si128 ((__m128i *)(state + 4), _mm_alignr_epi8 (state1, tmp, 8)); 
+	}
+
+	static void SHA256SHANI (const uint8_t * buf, size_t len, uint8_t * digest)
+	{
+		uint32_t state[8] = 
+		{
+			0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+		};
+		size_t numBlocks = len >> 6;
+		SHA256TransformSHANI (state, buf, numBlocks);
+		// padding, one or two last blocks
+		uint8_t last[128];
+		size_t rem = len & 0x3F;
+		memcpy (last, buf + (numBlocks << 6), rem);
+		last[rem] = 0x80;
+		size_t lastLen = (rem < 56) ? 64 : 128;
+		memset (last + rem + 1, 0, lastLen - rem - 1 - 8);
+		*(uint64_t *)(last + lastLen - 8) = htobe64 ((uint64_t)len << 3);
+		SHA256TransformSHANI (state, last, lastLen >> 6);
+		for (int i = 0; i < 8; i++)
+			((uint32_t *)digest)[i] = htobe32 (state[i]);
+	}
+#endif
+
+	void SHA256 (const uint8_t * buf, size_t len, uint8_t * digest)
+	{
+#if defined(AESNI)
+		if (i2p::cpu::shani)
+		{
+			SHA256SHANI (buf, len, digest);
+			return;
+		}
+#endif
+		CryptoPP::SHA256().CalculateDigest (digest, buf, len);
+	}
+}
+}
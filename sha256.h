@@ -0,0 +1,16 @@
+#ifndef SHA256_H__
+#define SHA256_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+namespace i2p
+{
+namespace crypto
+{
+	// SHA-NI if CPU supports it, crypto++ otherwise
+	void SHA256 (const uint8_t * buf, size_t len, uint8_t * digest); // digest is 32 bytes
+}
+}
+
+#endif